@@ -0,0 +1,18 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+namespace benchmark {
+    using Clock = std::chrono::steady_clock;
+
+    inline double elapsedSeconds(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    int benchmarkNop(int argc, char* argv[]);
+    int benchmarkTimer(int argc, char* argv[]);
+    int benchmarkPipe(int argc, char* argv[]);
+    int benchmarkSharedMemory(int argc, char* argv[]);
+    int benchmarkSync(int argc, char* argv[]);
+}
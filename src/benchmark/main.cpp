@@ -0,0 +1,28 @@
+#include <iostream>
+#include <string>
+
+#include "benchmarks.h"
+
+int main(int argc, char* argv[]) {
+    using namespace benchmark;
+
+    std::string command = "nop";
+    if (argc >= 2) {
+        command = argv[1];
+    }
+
+    if (command == "nop") {
+        return benchmarkNop(argc, argv);
+    } else if (command == "timer") {
+        return benchmarkTimer(argc, argv);
+    } else if (command == "pipe") {
+        return benchmarkPipe(argc, argv);
+    } else if (command == "shm") {
+        return benchmarkSharedMemory(argc, argv);
+    } else if (command == "sync") {
+        return benchmarkSync(argc, argv);
+    }
+
+    std::cout << "Unknown benchmark: " << command << std::endl;
+    return 1;
+}
@@ -0,0 +1,92 @@
+#include <iostream>
+
+#include "benchmarks.h"
+#include "../event_loop/loop.h"
+
+namespace benchmark {
+    namespace {
+        constexpr std::size_t operations = 1'000'000;
+        constexpr std::size_t inFlight = 32;
+
+        double runRawIoUring() {
+            io_uring ring {};
+            event_loop::EventLoopException::throwIfFailed(io_uring_queue_init(256, &ring, 0), "io_uring_queue_init");
+
+            auto start = Clock::now();
+
+            std::size_t submitted = 0;
+            for (; submitted < inFlight; submitted++) {
+                io_uring_prep_nop(io_uring_get_sqe(&ring));
+            }
+            io_uring_submit(&ring);
+
+            std::size_t completed = 0;
+            while (completed < operations) {
+                io_uring_cqe* cqe = nullptr;
+                io_uring_wait_cqe(&ring, &cqe);
+                io_uring_cqe_seen(&ring, cqe);
+                completed++;
+
+                if (submitted < operations) {
+                    io_uring_prep_nop(io_uring_get_sqe(&ring));
+                    io_uring_submit(&ring);
+                    submitted++;
+                }
+            }
+
+            auto elapsed = elapsedSeconds(start);
+            io_uring_queue_exit(&ring);
+            return elapsed;
+        }
+
+        double runEventLoop() {
+            using namespace std::chrono_literals;
+            using namespace event_loop;
+
+            std::stop_source stopSource;
+            EventLoop eventLoop;
+            std::cout << "Ring fd registered: " << (eventLoop.ringFdRegistered() ? "yes" : "no") << std::endl;
+
+            std::size_t submitted = 0;
+            std::size_t completed = 0;
+
+            NopEvent::Callback callback;
+            callback = [&](EventContext& context, const NopEvent::Response& response) {
+                completed++;
+
+                if (submitted < operations) {
+                    context.eventLoop.nop(callback);
+                    submitted++;
+                }
+            };
+
+            auto start = Clock::now();
+
+            {
+                SubmitGuard submitGuard(eventLoop);
+                for (; submitted < inFlight; submitted++) {
+                    eventLoop.nop(callback, &submitGuard);
+                }
+            }
+
+            while (completed < operations) {
+                eventLoop.runOnce(stopSource, 1s);
+            }
+
+            return elapsedSeconds(start);
+        }
+    }
+
+    int benchmarkNop(int argc, char* argv[]) {
+        auto report = [](const std::string& name, double elapsed) {
+            std::cout
+                << name << ": " << (double)operations / elapsed / 1.0E6 << " M ops/s"
+                << " (" << elapsed * 1.0E9 / (double)operations << " ns/op)"
+                << std::endl;
+        };
+
+        report("raw io_uring", runRawIoUring());
+        report(std::string("event loop (") + event_loop::Policy::name + " policy)", runEventLoop());
+        return 0;
+    }
+}
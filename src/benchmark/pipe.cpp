@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "benchmarks.h"
+#include "../event_loop/loop.h"
+
+namespace benchmark {
+    namespace {
+        struct PipeResult {
+            double elapsed = 0.0;
+            std::size_t received = 0;
+            bool exited = false;
+            std::optional<int> exitCode;
+        };
+
+        /**
+         * Pipes the given amount of data through cat, writing and reading through the event loop
+         */
+        PipeResult pipeThroughCat(std::size_t chunkSize, std::size_t totalSize) {
+            using namespace event_loop;
+
+            std::stop_source stopSource;
+            EventLoop eventLoop;
+            PipeResult pipeResult;
+
+            auto start = Clock::now();
+
+            std::vector<std::string> arguments { "cat" };
+            auto process = eventLoop.spawn(arguments, SpawnOptions {}, [&](EventContext& context, const ProcessExit& exit) {
+                if (exit.error) {
+                    std::cout << "Failed to wait for cat: " << exit.error->message() << std::endl;
+                }
+
+                pipeResult.exited = true;
+                pipeResult.exitCode = exit.exitCode;
+            });
+
+            auto input = *process.input;
+            auto output = *process.output;
+
+            auto chunk = Buffer { chunkSize };
+            std::size_t written = 0;
+
+            // One write in flight at a time, as concurrent writes to a pipe may be reordered
+            std::function<void (EventContext&, const WriteFileEvent::Response&)> writeCallback;
+            auto writeNext = [&](EventLoop& loop, std::size_t remainingInChunk) {
+                if (written >= totalSize) {
+                    loop.close(input, {});
+                    return;
+                }
+
+                auto size = std::min({ remainingInChunk, chunkSize, totalSize - written });
+                loop.writeFile(input, *chunk.slice(chunkSize - remainingInChunk, size), writeCallback);
+            };
+
+            std::size_t remainingInChunk = chunkSize;
+            writeCallback = [&](EventContext& context, const WriteFileEvent::Response& response) {
+                if (context.result <= 0) {
+                    std::cout << "Failed to write: " << *tryExtractError(context.result) << std::endl;
+                    context.eventLoop.close(input, {});
+                    return;
+                }
+
+                written += response.size;
+                remainingInChunk -= response.size;
+                if (remainingInChunk == 0) {
+                    remainingInChunk = chunkSize;
+                }
+
+                writeNext(context.eventLoop, remainingInChunk);
+            };
+
+            eventLoop.readFile(output, Buffer { chunkSize }, 0, [&](EventContext& context, const ReadFileEvent::Response& response) {
+                pipeResult.received += response.size;
+                if (response.size == 0) {
+                    context.eventLoop.close(output, {});
+                    return false;
+                }
+
+                return true;
+            });
+
+            writeNext(eventLoop, remainingInChunk);
+
+            while (!pipeResult.exited || pipeResult.received < totalSize) {
+                if (!eventLoop.runOnce(stopSource, std::chrono::seconds(5))) {
+                    std::cout << "Timed out" << std::endl;
+                    break;
+                }
+            }
+
+            pipeResult.elapsed = elapsedSeconds(start);
+            return pipeResult;
+        }
+    }
+
+    int benchmarkPipe(int argc, char* argv[]) {
+        std::size_t totalSize = 256 * 1024 * 1024;
+        if (argc >= 3) {
+            totalSize = std::stoul(argv[2]) * 1024 * 1024;
+        }
+
+        for (std::size_t chunkSize : { 4 * 1024, 64 * 1024, 256 * 1024 }) {
+            auto result = pipeThroughCat(chunkSize, totalSize);
+            std::cout
+                << "chunk " << chunkSize / 1024 << " KB: "
+                << (double)result.received / result.elapsed / (1024.0 * 1024.0) << " MB/s"
+                << " (received " << result.received << " of " << totalSize << " bytes"
+                << ", exit code " << result.exitCode.value_or(-1) << ")"
+                << std::endl;
+        }
+
+        return 0;
+    }
+}
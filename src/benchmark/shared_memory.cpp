@@ -0,0 +1,216 @@
+#include <iostream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "benchmarks.h"
+#include "../event_loop/loop.h"
+#include "../event_loop/shared_memory.h"
+
+namespace benchmark {
+    namespace {
+        constexpr std::size_t channelCapacity = 1024 * 1024;
+
+        /**
+         * Runs the sender and the receiver on their own loops and threads, returning the elapsed time
+         */
+        template<typename Sender, typename Receiver>
+        double runPair(Sender sender, Receiver receiver) {
+            auto start = Clock::now();
+
+            std::jthread receiverThread { [&]() {
+                receiver();
+            } };
+
+            sender();
+            receiverThread.join();
+            return elapsedSeconds(start);
+        }
+
+        void runUntil(event_loop::EventLoop& eventLoop, const bool& done) {
+            std::stop_source stopSource;
+            while (!done) {
+                eventLoop.runOnce(stopSource, std::chrono::seconds(1));
+            }
+        }
+
+        double runUnixSocket(std::size_t messageSize, std::size_t messages) {
+            using namespace event_loop;
+
+            int fds[2];
+            EventLoopException::throwIfFailed(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), "socketpair");
+
+            auto totalSize = messageSize * messages;
+            auto elapsed = runPair(
+                [&]() {
+                    EventLoop eventLoop;
+                    auto socket = Socket { fds[0] };
+                    auto message = Buffer { messageSize };
+
+                    std::size_t sent = 0;
+                    bool done = false;
+
+                    // One send in flight at a time, as concurrent sends may be reordered
+                    std::function<void (EventLoop&, Buffer)> sendNext;
+                    sendNext = [&](EventLoop& loop, Buffer data) {
+                        loop.send(socket, data, [&, data](EventContext& context, const SendEvent::Response& response) mutable {
+                            if (context.result <= 0) {
+                                std::cout << "Failed to send: " << *tryExtractError(context.result) << std::endl;
+                                done = true;
+                                return;
+                            }
+
+                            sent += response.size;
+                            if (sent == totalSize) {
+                                done = true;
+                            } else if (response.size < data.size()) {
+                                sendNext(context.eventLoop, *data.slice(response.size, data.size() - response.size));
+                            } else {
+                                sendNext(context.eventLoop, message);
+                            }
+                        });
+                    };
+
+                    sendNext(eventLoop, message);
+                    runUntil(eventLoop, done);
+                },
+                [&]() {
+                    EventLoop eventLoop;
+                    std::size_t received = 0;
+                    bool done = false;
+
+                    eventLoop.receive(Socket { fds[1] }, Buffer { channelCapacity }, [&](EventContext& context, const ReceiveEvent::Response& response) {
+                        received += response.size;
+                        done = response.size == 0 || received >= totalSize;
+                        return !done;
+                    });
+
+                    runUntil(eventLoop, done);
+                }
+            );
+
+            ::close(fds[0]);
+            ::close(fds[1]);
+            return elapsed;
+        }
+
+        double runSharedMemory(std::size_t messageSize, std::size_t messages) {
+            using namespace event_loop;
+
+            int fds[2];
+            EventLoopException::throwIfFailed(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), "socketpair");
+
+            // Both sides are opened before starting, so that the sender does not close the channel while in use
+            std::unique_ptr<SharedMemoryChannel> sendChannel;
+            std::unique_ptr<SharedMemoryChannel> receiveChannel;
+
+            {
+                EventLoop eventLoop;
+                SharedMemoryChannel::offer(eventLoop, Socket { fds[0] }, channelCapacity, [&](EventContext& context, Expected<std::unique_ptr<SharedMemoryChannel>> channel) {
+                    sendChannel = std::move(channel).valueOrThrow();
+                });
+
+                SharedMemoryChannel::accept(eventLoop, Socket { fds[1] }, [&](EventContext& context, Expected<std::unique_ptr<SharedMemoryChannel>> channel) {
+                    receiveChannel = std::move(channel).valueOrThrow();
+                });
+
+                std::stop_source stopSource;
+                while (!sendChannel || !receiveChannel) {
+                    eventLoop.runOnce(stopSource, std::chrono::seconds(1));
+                }
+            }
+
+            auto totalSize = messageSize * messages;
+            auto elapsed = runPair(
+                [&]() {
+                    EventLoop eventLoop;
+                    auto message = Buffer { messageSize };
+
+                    std::size_t sent = 0;
+                    bool done = false;
+
+                    // Sends complete right away while there is room, which must not recurse
+                    bool sending = false;
+                    bool sentRightAway = false;
+
+                    std::function<void (EventLoop&)> sendMore;
+                    sendMore = [&](EventLoop& loop) {
+                        while (sent < messages) {
+                            sending = true;
+                            sentRightAway = false;
+                            sendChannel->send(loop, message, [&](EventLoop& loop, bool success) {
+                                if (sending) {
+                                    sentRightAway = true;
+                                    return;
+                                }
+
+                                sent++;
+                                sendMore(loop);
+                            });
+                            sending = false;
+
+                            if (!sentRightAway) {
+                                return;
+                            }
+
+                            sent++;
+                        }
+
+                        done = true;
+                    };
+
+                    sendMore(eventLoop);
+                    runUntil(eventLoop, done);
+                },
+                [&]() {
+                    EventLoop eventLoop;
+                    std::size_t received = 0;
+                    bool done = false;
+
+                    receiveChannel->receive(eventLoop, [&](EventLoop& loop, std::span<const std::uint8_t> data) {
+                        received += data.size();
+                        done = data.empty() || received >= totalSize;
+                        return !done;
+                    });
+
+                    runUntil(eventLoop, done);
+                }
+            );
+
+            sendChannel->close();
+            ::close(fds[0]);
+            ::close(fds[1]);
+            return elapsed;
+        }
+    }
+
+    int benchmarkSharedMemory(int argc, char* argv[]) {
+        std::size_t totalSize = 256 * 1024 * 1024;
+        if (argc >= 3) {
+            totalSize = std::stoul(argv[2]) * 1024 * 1024;
+        }
+
+        for (std::size_t messageSize : { 64, 512, 4 * 1024, 64 * 1024 }) {
+            auto messages = totalSize / messageSize;
+            auto unixElapsed = runUnixSocket(messageSize, messages);
+            auto sharedElapsed = runSharedMemory(messageSize, messages);
+
+            auto rate = [&](double elapsed) {
+                return (double)(messages * messageSize) / elapsed / (1024.0 * 1024.0);
+            };
+
+            std::cout
+                << "message " << messageSize << " B: "
+                << "unix socket " << rate(unixElapsed) << " MB/s, "
+                << "shared memory " << rate(sharedElapsed) << " MB/s"
+                << " (" << messages / sharedElapsed / 1e6 << " M messages/s)"
+                << std::endl;
+        }
+
+        return 0;
+    }
+}
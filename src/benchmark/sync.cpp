@@ -0,0 +1,169 @@
+#include <iostream>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "benchmarks.h"
+#include "../event_loop/loop.h"
+#include "../event_loop/sync.h"
+
+namespace benchmark {
+    namespace {
+        void runUntil(event_loop::EventLoop& eventLoop, const bool& done) {
+            std::stop_source stopSource;
+            while (!done) {
+                eventLoop.runOnce(stopSource, std::chrono::seconds(1));
+            }
+        }
+
+        /**
+         * Increments a counter under the mutex from a thread blocking on it and from a loop waiting on it
+         */
+        double runMutex(std::size_t increments) {
+            using namespace event_loop;
+
+            AsyncMutex mutex;
+            std::size_t counter = 0;
+
+            auto start = Clock::now();
+            std::jthread thread { [&]() {
+                for (std::size_t i = 0; i < increments; i++) {
+                    mutex.lock();
+                    counter++;
+                    mutex.unlock();
+                }
+            } };
+
+            EventLoop eventLoop;
+            std::size_t loopIncrements = 0;
+            bool done = false;
+
+            // Locks complete right away when not contended, which must not recurse
+            bool locking = false;
+            bool lockedRightAway = false;
+
+            std::function<void (EventLoop&)> lockMore;
+            lockMore = [&](EventLoop& loop) {
+                while (loopIncrements < increments) {
+                    locking = true;
+                    lockedRightAway = false;
+                    mutex.lock(loop, [&](EventLoop& loop, Expected<> locked) {
+                        if (!locked) {
+                            std::cout << "Failed to lock: " << locked.error().message() << std::endl;
+                            done = true;
+                            return;
+                        }
+
+                        counter++;
+                        loopIncrements++;
+                        mutex.unlock();
+
+                        if (locking) {
+                            lockedRightAway = true;
+                            return;
+                        }
+
+                        lockMore(loop);
+                    });
+                    locking = false;
+
+                    if (!lockedRightAway) {
+                        return;
+                    }
+                }
+
+                done = true;
+            };
+
+            lockMore(eventLoop);
+            runUntil(eventLoop, done);
+            thread.join();
+
+            auto elapsed = elapsedSeconds(start);
+            if (counter != 2 * increments) {
+                std::cout << "Lost increments: " << counter << " of " << 2 * increments << std::endl;
+            }
+
+            return elapsed;
+        }
+
+        /**
+         * Sends values from a thread blocking on the channel to a loop waiting on it
+         */
+        double runChannel(std::size_t capacity, std::size_t messages) {
+            using namespace event_loop;
+
+            AsyncChannel<std::uint64_t> channel { capacity };
+
+            auto start = Clock::now();
+            std::jthread thread { [&]() {
+                for (std::size_t i = 0; i < messages; i++) {
+                    channel.send(i);
+                }
+            } };
+
+            EventLoop eventLoop;
+            std::size_t received = 0;
+            bool done = false;
+
+            bool receiving = false;
+            bool receivedRightAway = false;
+
+            std::function<void (EventLoop&)> receiveMore;
+            receiveMore = [&](EventLoop& loop) {
+                while (received < messages) {
+                    receiving = true;
+                    receivedRightAway = false;
+                    channel.receive(loop, [&](EventLoop& loop, Expected<std::uint64_t> value) {
+                        if (!value) {
+                            std::cout << "Failed to receive: " << value.error().message() << std::endl;
+                            done = true;
+                            return;
+                        }
+
+                        if (*value != received) {
+                            std::cout << "Received " << *value << ", expected " << received << std::endl;
+                        }
+
+                        received++;
+                        if (receiving) {
+                            receivedRightAway = true;
+                            return;
+                        }
+
+                        receiveMore(loop);
+                    });
+                    receiving = false;
+
+                    if (!receivedRightAway) {
+                        return;
+                    }
+                }
+
+                done = true;
+            };
+
+            receiveMore(eventLoop);
+            runUntil(eventLoop, done);
+            thread.join();
+            return elapsedSeconds(start);
+        }
+    }
+
+    int benchmarkSync(int argc, char* argv[]) {
+        std::size_t count = 1000000;
+        if (argc >= 3) {
+            count = std::stoul(argv[2]);
+        }
+
+        auto mutexElapsed = runMutex(count);
+        std::cout << "mutex: " << 2 * count / mutexElapsed / 1e6 << " M locks/s" << std::endl;
+
+        for (std::size_t capacity : { 1, 64, 4096 }) {
+            auto channelElapsed = runChannel(capacity, count);
+            std::cout << "channel " << capacity << ": " << count / channelElapsed / 1e6 << " M messages/s" << std::endl;
+        }
+
+        return 0;
+    }
+}
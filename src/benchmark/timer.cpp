@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "benchmarks.h"
+#include "../event_loop/loop.h"
+
+namespace benchmark {
+    namespace {
+        using namespace std::chrono_literals;
+
+        struct TimerScenario {
+            std::string name;
+            std::size_t timers = 0;
+            std::vector<std::chrono::milliseconds> intervals;
+            std::size_t firesPerTimer = 1;
+            std::chrono::milliseconds slack { 0 };
+            bool ioLoad = false;
+        };
+
+        struct TimerResult {
+            // Fire time errors (actual - expected) in microseconds
+            std::vector<double> errors;
+            double elapsed = 0.0;
+            std::uint64_t wakeups = 0;
+        };
+
+        /**
+         * Keeps the event loop busy by sending messages back and forth over socket pairs
+         */
+        class IoLoad {
+        private:
+            std::vector<std::pair<int, int>> mSocketPairs;
+            std::shared_ptr<bool> mRunning = std::make_shared<bool>(true);
+        public:
+            IoLoad(event_loop::EventLoop& eventLoop, std::size_t pairs, std::size_t messageSize) {
+                using namespace event_loop;
+
+                for (std::size_t i = 0; i < pairs; i++) {
+                    int fds[2];
+                    EventLoopException::throwIfFailed(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), "socketpair");
+                    mSocketPairs.emplace_back(fds[0], fds[1]);
+
+                    for (auto [receiver, sender] : { std::pair { fds[0], fds[1] }, std::pair { fds[1], fds[0] } }) {
+                        eventLoop.receive(Socket { receiver }, Buffer { messageSize }, [running = mRunning, sender, messageSize](EventContext& context, const ReceiveEvent::Response& response) {
+                            if (response.size == 0 || !*running) {
+                                return false;
+                            }
+
+                            context.eventLoop.send(Socket { sender }, context.eventLoop.allocate(response.size), [](EventContext& context, const SendEvent::Response& response) {});
+                            return true;
+                        });
+                    }
+
+                    eventLoop.send(Socket { fds[0] }, Buffer { messageSize }, {});
+                }
+            }
+
+            ~IoLoad() {
+                *mRunning = false;
+                for (auto [first, second] : mSocketPairs) {
+                    ::close(first);
+                    ::close(second);
+                }
+            }
+        };
+
+        TimerResult runScenario(const TimerScenario& scenario) {
+            using namespace event_loop;
+            using TimerClock = TimerEvent::Clock;
+
+            std::stop_source stopSource;
+            auto eventLoop = std::make_unique<EventLoop>(4096);
+
+            std::unique_ptr<IoLoad> ioLoad;
+            if (scenario.ioLoad) {
+                ioLoad = std::make_unique<IoLoad>(*eventLoop, 8, 4096);
+            }
+
+            TimerResult result;
+            result.errors.reserve(scenario.timers * scenario.firesPerTimer);
+
+            std::mt19937 random { 1337 };
+            std::uniform_int_distribution<std::size_t> intervalDistribution { 0, scenario.intervals.size() - 1 };
+
+            std::size_t remaining = scenario.timers;
+            auto start = Clock::now();
+            for (std::size_t i = 0; i < scenario.timers; i++) {
+                auto interval = scenario.intervals[intervalDistribution(random)];
+
+                auto callback = [&, interval, expected = TimerClock::now() + interval, fires = (std::size_t)0](EventContext& context, const TimerEvent::Response& response) mutable {
+                    auto now = TimerClock::now();
+                    result.errors.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - expected).count() / 1.0E3);
+
+                    // Periodic timers are restarted from when the callback is called
+                    fires++;
+                    expected = now + interval;
+                    if (fires >= scenario.firesPerTimer) {
+                        remaining--;
+                        return false;
+                    }
+
+                    return true;
+                };
+
+                eventLoop->timer(interval, scenario.slack, std::move(callback));
+            }
+
+            while (remaining > 0) {
+                eventLoop->runOnce(stopSource, 1s);
+            }
+
+            result.elapsed = elapsedSeconds(start);
+            result.wakeups = eventLoop->metrics().timerWakeups.value();
+            return result;
+        }
+
+        double percentile(const std::vector<double>& sortedValues, double percentile) {
+            if (sortedValues.empty()) {
+                return 0.0;
+            }
+
+            auto index = (std::size_t)(percentile * (double)(sortedValues.size() - 1));
+            return sortedValues[index];
+        }
+    }
+
+    int benchmarkTimer(int argc, char* argv[]) {
+        std::vector<std::chrono::milliseconds> intervals { 1ms, 5ms, 10ms, 50ms, 100ms };
+
+        std::vector<TimerScenario> scenarios;
+        for (auto ioLoad : { false, true }) {
+            std::string load = ioLoad ? "io load" : "idle";
+            scenarios.push_back({ "one-shot (" + load + ")", 10000, intervals, 1, 0ms, ioLoad });
+            scenarios.push_back({ "periodic (" + load + ")", 1000, intervals, 10, 0ms, ioLoad });
+            scenarios.push_back({ "periodic 10ms slack (" + load + ")", 1000, intervals, 10, 10ms, ioLoad });
+        }
+
+        for (auto& scenario : scenarios) {
+            auto result = runScenario(scenario);
+            std::sort(result.errors.begin(), result.errors.end());
+
+            std::cout
+                << scenario.name << ": "
+                << "p50: " << percentile(result.errors, 0.5) << " us"
+                << ", p99: " << percentile(result.errors, 0.99) << " us"
+                << ", max: " << (result.errors.empty() ? 0.0 : result.errors.back()) << " us"
+                << ", timer ops/s: " << (double)result.errors.size() / result.elapsed;
+
+            if (scenario.slack.count() > 0) {
+                std::cout << ", wakeups: " << result.wakeups;
+            }
+
+            std::cout << std::endl;
+        }
+
+        return 0;
+    }
+}
@@ -3,21 +3,39 @@
 #include "buffer.h"
 
 namespace event_loop {
-    BufferData::BufferData(std::size_t size)
-        : mSize(size), mData(std::make_unique<std::uint8_t[]>(size)) {
+    BufferData::BufferData(std::size_t size, std::pmr::memory_resource* resource)
+        : mSize(size), mResource(resource) {
         clear();
     }
 
+    std::size_t BufferData::allocationSize(std::size_t size) {
+        static_assert(dataOffset >= sizeof(BufferData));
+        return dataOffset + size;
+    }
+
+    BufferData* BufferData::create(std::size_t size, std::pmr::memory_resource* resource) {
+        auto allocation = resource->allocate(allocationSize(size), alignment);
+        return new (allocation) BufferData(size, resource);
+    }
+
+    void BufferData::destroy() {
+        auto resource = mResource;
+        auto size = allocationSize(mSize);
+        this->~BufferData();
+        resource->deallocate(this, size, alignment);
+    }
+
     std::size_t BufferData::size() const {
         return mSize;
     }
 
     std::uint8_t* BufferData::data() const {
-        return mData.get();
+        // The data is placed directly after the header
+        return (std::uint8_t*)this + dataOffset;
     }
 
     void BufferData::clear() {
-        std::memset(mData.get(), 0, mSize);
+        std::memset(data(), 0, mSize);
     }
 
     std::size_t BufferData::useCount() const {
@@ -28,12 +46,17 @@ namespace event_loop {
         mUseCount++;
     }
 
-    void BufferData::decreaseUse() {
-        mUseCount--;
+    std::size_t BufferData::decreaseUse() {
+        return --mUseCount;
     }
 
     Buffer::Buffer(std::size_t size)
-        : mUnderlying(new BufferData(size)), mSize(size) {
+        : Buffer(size, std::pmr::get_default_resource()) {
+
+    }
+
+    Buffer::Buffer(std::size_t size, std::pmr::memory_resource* resource)
+        : mUnderlying(BufferData::create(size, resource)), mSize(size) {
         mUnderlying->increaseUse();
     }
 
@@ -144,9 +167,8 @@ namespace event_loop {
 
     void Buffer::decreaseUse() {
         if (mUnderlying != nullptr) {
-            mUnderlying->decreaseUse();
-            if (mUnderlying->useCount() == 0) {
-                delete mUnderlying;
+            if (mUnderlying->decreaseUse() == 0) {
+                mUnderlying->destroy();
                 mUnderlying = nullptr;
                 mOffset = 0;
                 mSize = 0;
@@ -154,20 +176,36 @@ namespace event_loop {
         }
     }
 
+    BufferManager::BufferManager(std::pmr::memory_resource* resource)
+        : mResource(CountingResource::create(resource)), mBuffers(resource) {
+
+    }
+
     Buffer BufferManager::allocate(std::size_t size) {
         for (std::size_t index = 0; index < mBuffers.size(); index++) {
             if (auto buffer = mBuffers[index].slice(0, size)) {
+                mPooledBytes -= mBuffers[index].size();
                 mBuffers.erase(mBuffers.begin() + (std::int64_t)index);
                 return *buffer;
             }
         }
 
         constexpr auto bufferSize = 32;
-        Buffer buffer { ((size + bufferSize - 1) / bufferSize) * bufferSize };
+        Buffer buffer { ((size + bufferSize - 1) / bufferSize) * bufferSize, mResource.get() };
         return *(buffer.slice(0, size));
     }
 
     void BufferManager::deallocate(Buffer buffer) {
+        mPooledBytes += buffer.size();
         mBuffers.push_back(std::move(buffer));
     }
+
+    BufferManager::Stats BufferManager::stats() const {
+        return Stats {
+            .allocatedBytes = mResource->allocatedBytes(),
+            .allocatedBuffers = mResource->allocations(),
+            .pooledBytes = mPooledBytes,
+            .pooledBuffers = mBuffers.size()
+        };
+    }
 }
\ No newline at end of file
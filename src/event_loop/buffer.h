@@ -4,16 +4,30 @@
 #include <cstdint>
 #include <vector>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 
+#include "config.h"
+#include "memory.h"
+
 namespace event_loop {
+    /**
+     * The reference counted storage of buffers, allocated together with its data in a single allocation
+     */
     class BufferData {
     private:
-        std::size_t mUseCount = 0;
+        BufferReferenceCount mUseCount { 0 };
         std::size_t mSize = 0;
-        std::unique_ptr<std::uint8_t[]> mData;
+        std::pmr::memory_resource* mResource = nullptr;
+
+        static constexpr std::size_t alignment = alignof(std::max_align_t);
+        static constexpr std::size_t dataOffset = ((sizeof(BufferReferenceCount) + 2 * sizeof(std::size_t) + alignment - 1) / alignment) * alignment;
+
+        BufferData(std::size_t size, std::pmr::memory_resource* resource);
+        static std::size_t allocationSize(std::size_t size);
     public:
-        explicit BufferData(std::size_t size);
+        static BufferData* create(std::size_t size, std::pmr::memory_resource* resource);
+        void destroy();
 
         std::size_t size() const;
         std::uint8_t* data() const;
@@ -21,7 +35,11 @@ namespace event_loop {
 
         std::size_t useCount() const;
         void increaseUse();
-        void decreaseUse();
+
+        /**
+         * Decreases the use count, returning the remaining uses
+         */
+        std::size_t decreaseUse();
     };
 
     class Buffer {
@@ -34,6 +52,7 @@ namespace event_loop {
         Buffer(BufferData* data, std::size_t offset, std::size_t size);
     public:
         explicit Buffer(std::size_t size);
+        Buffer(std::size_t size, std::pmr::memory_resource* resource);
         ~Buffer();
 
         static Buffer fromString(const std::string_view& string);
@@ -53,11 +72,37 @@ namespace event_loop {
         std::size_t useCount() const;
     };
 
+    /**
+     * Pools buffers for reuse. Buffers may outlive the manager, as long as the resource it was created with outlives them.
+     */
     class BufferManager {
+    public:
+        struct Stats {
+            // Bytes of all live buffers allocated by the manager (in use or pooled)
+            std::size_t allocatedBytes = 0;
+
+            // Number of live buffers allocated by the manager
+            std::size_t allocatedBuffers = 0;
+
+            // Bytes of the buffers waiting in the pool
+            std::size_t pooledBytes = 0;
+
+            // Number of buffers waiting in the pool
+            std::size_t pooledBuffers = 0;
+        };
     private:
-        std::vector<Buffer> mBuffers;
+        CountingResourcePointer mResource;
+        std::pmr::vector<Buffer> mBuffers;
+        std::size_t mPooledBytes = 0;
     public:
+        explicit BufferManager(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        BufferManager(const BufferManager&) = delete;
+        BufferManager& operator=(const BufferManager&) = delete;
+
         Buffer allocate(std::size_t size);
         void deallocate(Buffer buffer);
+
+        Stats stats() const;
     };
 }
\ No newline at end of file
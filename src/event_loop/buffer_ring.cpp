@@ -0,0 +1,116 @@
+#include "buffer_ring.h"
+
+#include <sys/mman.h>
+
+namespace event_loop {
+    BufferGroupIds::BufferGroupIds(std::pmr::memory_resource* resource)
+        : mFree(resource) {
+
+    }
+
+    std::optional<std::uint16_t> BufferGroupIds::allocate() {
+        if (!mFree.empty()) {
+            auto id = mFree.back();
+            mFree.pop_back();
+            return id;
+        }
+
+        if (mNext > UINT16_MAX) {
+            return {};
+        }
+
+        return (std::uint16_t)mNext++;
+    }
+
+    void BufferGroupIds::release(std::uint16_t id) {
+        mFree.push_back(id);
+    }
+
+    void BufferGroupIds::ringExited() {
+        mRingExited = true;
+    }
+
+    bool BufferGroupIds::hasRingExited() const {
+        return mRingExited;
+    }
+
+    ProvidedBufferRing::ProvidedBufferRing(io_uring& ring, BufferGroupIds& groupIds, std::uint16_t groupId, std::uint32_t count, std::size_t bufferSize, std::pmr::memory_resource* resource)
+        : mRing(ring),
+          mGroupIds(groupIds),
+          mGroupId(groupId),
+          mCount(count),
+          mBufferSize(bufferSize),
+          mResource(resource) {
+
+    }
+
+    Expected<std::unique_ptr<ProvidedBufferRing>> ProvidedBufferRing::create(
+        io_uring& ring,
+        BufferGroupIds& groupIds,
+        std::uint32_t count,
+        std::size_t bufferSize,
+        std::pmr::memory_resource* resource
+    ) {
+        auto groupId = groupIds.allocate();
+        if (!groupId) {
+            return Error { "io_uring_setup_buf_ring", -ENOSPC };
+        }
+
+        std::unique_ptr<ProvidedBufferRing> bufferRing { new ProvidedBufferRing(ring, groupIds, *groupId, count, bufferSize, resource) };
+
+        int result = 0;
+        bufferRing->mBufferRing = io_uring_setup_buf_ring(&ring, count, *groupId, 0, &result);
+        if (bufferRing->mBufferRing == nullptr) {
+            return Error { "io_uring_setup_buf_ring", result };
+        }
+
+        bufferRing->mBuffers = (std::uint8_t*)resource->allocate(count * bufferSize, alignof(std::max_align_t));
+        for (std::uint32_t bufferId = 0; bufferId < count; bufferId++) {
+            io_uring_buf_ring_add(
+                bufferRing->mBufferRing,
+                bufferRing->buffer(bufferId),
+                bufferSize,
+                bufferId,
+                io_uring_buf_ring_mask(count),
+                (int)bufferId
+            );
+        }
+        io_uring_buf_ring_advance(bufferRing->mBufferRing, (int)count);
+
+        return bufferRing;
+    }
+
+    ProvidedBufferRing::~ProvidedBufferRing() {
+        if (mBufferRing != nullptr) {
+            if (mGroupIds.hasRingExited()) {
+                // Mapped by io_uring_setup_buf_ring, where the kernel no longer refers to it
+                munmap(mBufferRing, mCount * sizeof(io_uring_buf));
+            } else {
+                io_uring_free_buf_ring(&mRing, mBufferRing, mCount, mGroupId);
+            }
+        }
+
+        if (mBuffers != nullptr) {
+            mResource->deallocate(mBuffers, mCount * mBufferSize, alignof(std::max_align_t));
+        }
+
+        mGroupIds.release(mGroupId);
+    }
+
+    std::uint16_t ProvidedBufferRing::groupId() const {
+        return mGroupId;
+    }
+
+    std::size_t ProvidedBufferRing::bufferSize() const {
+        return mBufferSize;
+    }
+
+    std::uint8_t* ProvidedBufferRing::buffer(std::uint16_t bufferId) const {
+        return mBuffers + (std::size_t)bufferId * mBufferSize;
+    }
+
+    void ProvidedBufferRing::recycle(std::uint16_t bufferId) {
+        io_uring_buf_ring_add(mBufferRing, buffer(bufferId), mBufferSize, bufferId, io_uring_buf_ring_mask(mCount), 0);
+        io_uring_buf_ring_advance(mBufferRing, 1);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+#include <liburing.h>
+
+#include "common.h"
+
+namespace event_loop {
+    /**
+     * Allocates the group ids of the provided buffer rings of a ring, reusing the ids of destroyed rings
+     */
+    class BufferGroupIds {
+    private:
+        std::uint32_t mNext = 0;
+        std::pmr::vector<std::uint16_t> mFree;
+        bool mRingExited = false;
+    public:
+        explicit BufferGroupIds(std::pmr::memory_resource* resource);
+
+        /**
+         * Returns a free id, none if all are in use
+         */
+        std::optional<std::uint16_t> allocate();
+        void release(std::uint16_t id);
+
+        /**
+         * Marks the ring as exited, after which the provided buffer rings are only unmapped when destroyed, as
+         * exiting the ring unregistered them
+         */
+        void ringExited();
+        bool hasRingExited() const;
+    };
+
+    /**
+     * Ring of buffers provided to the kernel, where the kernel selects a buffer when an operation completes
+     */
+    class ProvidedBufferRing {
+    private:
+        io_uring& mRing;
+        io_uring_buf_ring* mBufferRing = nullptr;
+        BufferGroupIds& mGroupIds;
+        std::uint16_t mGroupId = 0;
+        std::uint32_t mCount = 0;
+        std::size_t mBufferSize = 0;
+
+        std::pmr::memory_resource* mResource = nullptr;
+        std::uint8_t* mBuffers = nullptr;
+
+        ProvidedBufferRing(io_uring& ring, BufferGroupIds& groupIds, std::uint16_t groupId, std::uint32_t count, std::size_t bufferSize, std::pmr::memory_resource* resource);
+    public:
+        /**
+         * Creates a new ring with the given number of buffers (must be a power of two) of the given size.
+         * The group id is allocated from the given ids, which must outlive the ring.
+         */
+        static Expected<std::unique_ptr<ProvidedBufferRing>> create(
+            io_uring& ring,
+            BufferGroupIds& groupIds,
+            std::uint32_t count,
+            std::size_t bufferSize,
+            std::pmr::memory_resource* resource
+        );
+        ~ProvidedBufferRing();
+
+        ProvidedBufferRing(const ProvidedBufferRing&) = delete;
+        ProvidedBufferRing& operator=(const ProvidedBufferRing&) = delete;
+
+        std::uint16_t groupId() const;
+        std::size_t bufferSize() const;
+
+        /**
+         * Returns the buffer with the given id
+         */
+        std::uint8_t* buffer(std::uint16_t bufferId) const;
+
+        /**
+         * Returns the buffer with the given id to the kernel
+         */
+        void recycle(std::uint16_t bufferId);
+    };
+}
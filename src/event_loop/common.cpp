@@ -1,15 +1,20 @@
 #include "common.h"
 
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
 namespace event_loop {
     EventLoopException::EventLoopException(const std::string& operation, int errorCode)
-        : mMessage(fmt::format("Operation '{}' failed due to: {}.", operation, *tryExtractError(errorCode))),
+        : mOperation(operation),
           mErrorCode(-errorCode) {
 
     }
 
     int EventLoopException::throwIfFailed(int result, const std::string& operation) {
         if (result < 0) {
-            throw EventLoopException(operation, result);
+            Error(operation.c_str(), result).raise();
         }
 
         return result;
@@ -20,9 +25,45 @@ namespace event_loop {
     }
 
     const char* EventLoopException::what() const noexcept {
+        // Formatting is deferred until the message is requested as most exceptions are never printed
+        if (mMessage.empty()) {
+            mMessage = fmt::format("Operation '{}' failed due to: {}.", mOperation, errorNumberToString(mErrorCode));
+        }
+
         return mMessage.c_str();
     }
 
+    Error::Error(const char* operation, int result)
+        : mOperation(operation),
+          mErrorCode(-result) {
+
+    }
+
+    Error Error::fromErrorNumber(const char* operation) {
+        return Error { operation, -errno };
+    }
+
+    const char* Error::operation() const {
+        return mOperation;
+    }
+
+    int Error::errorCode() const {
+        return mErrorCode;
+    }
+
+    std::string Error::message() const {
+        return fmt::format("Operation '{}' failed due to: {}.", mOperation, errorNumberToString(mErrorCode));
+    }
+
+    void Error::raise() const {
+#if defined(__cpp_exceptions)
+        throw EventLoopException(mOperation, -mErrorCode);
+#else
+        std::cerr << message() << std::endl;
+        std::abort();
+#endif
+    }
+
     std::string errorNumberToString(int errorNumber) {
         return strerror(errorNumber);
     }
@@ -34,4 +75,4 @@ namespace event_loop {
             return { errorNumberToString(-result) };
         }
     }
-}
\ No newline at end of file
+}
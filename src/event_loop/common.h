@@ -1,11 +1,15 @@
 #pragma once
 
+#include <memory_resource>
 #include <stop_token>
 #include <string>
 #include <optional>
+#include <variant>
 
 #include "fmt/format.h"
 
+#include <linux/io_uring.h>
+
 namespace event_loop {
     using Fd = int;
     using EventId = std::uint64_t;
@@ -16,29 +20,66 @@ namespace event_loop {
         EventLoop& eventLoop;
         std::stop_source& stopSource;
         Result result;
+        std::uint32_t flags;
+
+        // Allocator for transient allocations, released at the end of the current event loop iteration
+        std::pmr::memory_resource& arena;
 
         inline std::size_t resultAsSize() const {
             return result > 0 ? (std::size_t)result : 0;
         }
+
+        /**
+         * Indicates if more completions will be posted for the event (multishot operations)
+         */
+        inline bool hasMore() const {
+            return (flags & IORING_CQE_F_MORE) != 0;
+        }
     };
 
     struct Event {
+        using HandleFunction = bool (*)(Event& event, EventContext& context);
+
         EventId id = 0;
+        HandleFunction handleFunction = nullptr;
 
-        explicit Event(EventId id)
-            : id(id) {
+        Event(EventId id, HandleFunction handleFunction)
+            : id(id), handleFunction(handleFunction) {
 
         }
         virtual ~Event() = default;
 
         virtual std::string name() const = 0;
-        virtual bool handle(EventContext& context) = 0;
+
+        /**
+         * Handles a completion of the event, returning true if the event is still in use.
+         * Dispatched through a function pointer to the concrete event type rather than a virtual call.
+         */
+        inline bool handle(EventContext& context) {
+            return handleFunction(*this, context);
+        }
+    };
+
+    /**
+     * Base for concrete events, which must define bool handle(EventContext& context)
+     */
+    template<typename T>
+    struct TypedEvent : public Event {
+        explicit TypedEvent(EventId id)
+            : Event(id, &TypedEvent::handleEvent) {
+
+        }
+    private:
+        static bool handleEvent(Event& event, EventContext& context) {
+            return static_cast<T&>(event).handle(context);
+        }
     };
 
     class EventLoopException : public std::exception {
     private:
+        std::string mOperation;
         int mErrorCode = 0;
-        std::string mMessage;
+        mutable std::string mMessage;
     public:
         explicit EventLoopException(const std::string& operation, int errorCode);
         static int throwIfFailed(int result, const std::string& operation);
@@ -47,6 +88,142 @@ namespace event_loop {
         const char* what() const noexcept override;
     };
 
+    /**
+     * An error returned by the non-throwing operations. The message is only created on demand.
+     */
+    class Error {
+    private:
+        const char* mOperation = "";
+        int mErrorCode = 0;
+    public:
+        /**
+         * Creates a new error from the given (negative) result
+         */
+        Error(const char* operation, int result);
+
+        /**
+         * Creates a new error from the current errno
+         */
+        static Error fromErrorNumber(const char* operation);
+
+        const char* operation() const;
+        int errorCode() const;
+        std::string message() const;
+
+        /**
+         * Throws this error as an EventLoopException, or aborts when compiled without exceptions
+         */
+        [[noreturn]] void raise() const;
+    };
+
+    /**
+     * Either a value or an error
+     */
+    template<typename T = void>
+    class [[nodiscard]] Expected {
+    private:
+        std::variant<T, Error> mValue;
+    public:
+        Expected(T value)
+            : mValue(std::in_place_index<0>, std::move(value)) {
+
+        }
+
+        Expected(Error error)
+            : mValue(std::in_place_index<1>, error) {
+
+        }
+
+        bool hasValue() const {
+            return mValue.index() == 0;
+        }
+
+        explicit operator bool() const {
+            return hasValue();
+        }
+
+        T& value() {
+            return std::get<0>(mValue);
+        }
+
+        const T& value() const {
+            return std::get<0>(mValue);
+        }
+
+        T& operator*() {
+            return value();
+        }
+
+        T* operator->() {
+            return &value();
+        }
+
+        const Error& error() const {
+            return std::get<1>(mValue);
+        }
+
+        T valueOrThrow() && {
+            if (!hasValue()) {
+                error().raise();
+            }
+
+            return std::move(value());
+        }
+    };
+
+    template<>
+    class [[nodiscard]] Expected<void> {
+    private:
+        std::optional<Error> mError;
+    public:
+        Expected() = default;
+
+        Expected(Error error)
+            : mError(error) {
+
+        }
+
+        bool hasValue() const {
+            return !mError.has_value();
+        }
+
+        explicit operator bool() const {
+            return hasValue();
+        }
+
+        const Error& error() const {
+            return *mError;
+        }
+
+        void valueOrThrow() const {
+            if (mError) {
+                mError->raise();
+            }
+        }
+    };
+
+    /**
+     * Returns the given result if successful (non-negative) or else an error
+     */
+    inline Expected<int> checkResult(int result, const char* operation) {
+        if (result < 0) {
+            return Error { operation, result };
+        }
+
+        return result;
+    }
+
+    /**
+     * Returns the given result of a system call if successful or else an error from errno
+     */
+    inline Expected<int> checkSystemCall(int result, const char* operation) {
+        if (result < 0) {
+            return Error::fromErrorNumber(operation);
+        }
+
+        return result;
+    }
+
     std::string errorNumberToString(int errorNumber);
     std::optional<std::string> tryExtractError(int result);
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+
+#if defined(EVENT_LOOP_POLICY_HEADER)
+#include EVENT_LOOP_POLICY_HEADER
+#endif
+
+namespace event_loop {
+    /**
+     * The default policy: dispatch from any thread and metrics enabled
+     */
+    struct DefaultPolicy {
+        static constexpr const char* name = "Default";
+
+        // If dispatch can be called from other threads than the event loop thread
+        static constexpr bool threadSafeDispatch = true;
+
+        // If metrics are collected (see EventLoop::metrics)
+        static constexpr bool collectMetrics = true;
+
+        // If buffers use atomic reference counting, allowing them to be shared between threads
+        static constexpr bool atomicBufferReferences = false;
+    };
+
+    /**
+     * Policy for event loops only used from their own thread, with all optional features compiled away
+     */
+    struct MinimalPolicy {
+        static constexpr const char* name = "Minimal";
+
+        static constexpr bool threadSafeDispatch = false;
+        static constexpr bool collectMetrics = false;
+        static constexpr bool atomicBufferReferences = false;
+    };
+
+    /**
+     * The policy used by the event loop, selected at compile time with EVENT_LOOP_POLICY
+     */
+#if defined(EVENT_LOOP_POLICY)
+    using Policy = EVENT_LOOP_POLICY;
+#else
+    using Policy = DefaultPolicy;
+#endif
+
+    struct NullMutex {
+        void lock() {}
+        bool try_lock() { return true; }
+        void unlock() {}
+    };
+
+    using DispatchMutex = std::conditional_t<Policy::threadSafeDispatch, std::mutex, NullMutex>;
+
+    using BufferReferenceCount = std::conditional_t<
+        Policy::atomicBufferReferences,
+        std::atomic<std::size_t>,
+        std::size_t
+    >;
+
+    template<bool Enabled>
+    class MetricCounter {
+    private:
+        std::uint64_t mValue = 0;
+    public:
+        void operator++(int) {
+            mValue++;
+        }
+
+        void operator+=(std::uint64_t value) {
+            mValue += value;
+        }
+
+        std::uint64_t value() const {
+            return mValue;
+        }
+    };
+
+    template<>
+    class MetricCounter<false> {
+    public:
+        void operator++(int) {}
+        void operator+=(std::uint64_t) {}
+
+        std::uint64_t value() const {
+            return 0;
+        }
+    };
+
+    using Counter = MetricCounter<Policy::collectMetrics>;
+}
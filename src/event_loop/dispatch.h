@@ -0,0 +1,80 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "loop.h"
+
+namespace event_loop {
+    /**
+     * Typed queue used for posting items (potentially from other threads) to be handled on the event loop thread.
+     * All items posted before the event loop gets to them are handled in one pass with a single call to the handler.
+     */
+    template<typename T>
+    class DispatchBatch {
+    public:
+        using Handler = std::function<void (EventLoop& eventLoop, std::span<const T> items)>;
+    private:
+        struct State {
+            EventLoop& eventLoop;
+            Handler handler;
+
+            std::mutex mutex;
+            std::vector<T> pending;
+            std::vector<T> executing;
+            bool scheduled = false;
+
+            State(EventLoop& eventLoop, Handler handler, std::size_t capacity)
+                : eventLoop(eventLoop), handler(std::move(handler)) {
+                pending.reserve(capacity);
+                executing.reserve(capacity);
+            }
+        };
+
+        std::shared_ptr<State> mState;
+
+        static void execute(State& state) {
+            {
+                std::scoped_lock guard(state.mutex);
+                std::swap(state.pending, state.executing);
+                state.scheduled = false;
+            }
+
+            state.handler(state.eventLoop, std::span<const T>(state.executing));
+
+            // Keeps the capacity, so storage is only reallocated when a batch is larger than any before
+            state.executing.clear();
+        }
+    public:
+        explicit DispatchBatch(EventLoop& eventLoop, Handler handler, std::size_t capacity = 1024)
+            : mState(std::make_shared<State>(eventLoop, std::move(handler), capacity)) {
+
+        }
+
+        /**
+         * Posts the given items, only the first post of a batch synchronizes with the event loop
+         */
+        void post(std::span<const T> items) {
+            bool schedule = false;
+            {
+                std::scoped_lock guard(mState->mutex);
+                mState->pending.insert(mState->pending.end(), items.begin(), items.end());
+                schedule = !mState->scheduled;
+                mState->scheduled = true;
+            }
+
+            if (schedule) {
+                mState->eventLoop.dispatch([state = mState](EventLoop& eventLoop) {
+                    execute(*state);
+                });
+            }
+        }
+
+        void post(const T& item) {
+            post(std::span<const T>(&item, 1));
+        }
+    };
+}
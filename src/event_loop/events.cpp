@@ -1,9 +1,32 @@
 #include "events.h"
 #include "loop.h"
 
+#include <cstring>
+
+#include <netinet/udp.h>
+
 namespace event_loop {
+    NopEvent::NopEvent(EventId id, NopEvent::Callback callback)
+        : TypedEvent(id),
+          callback(std::move(callback)) {
+
+    }
+
+    std::string NopEvent::name() const {
+        return "Nop";
+    }
+
+    bool NopEvent::handle(EventContext& context) {
+        if (!callback) {
+            return false;
+        }
+
+        callback(context, {});
+        return false;
+    }
+
     CloseEvent::CloseEvent(EventId id, AnyFd fd, CloseEvent::Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           fd(fd),
           callback(std::move(callback)) {
 
@@ -22,14 +45,19 @@ namespace event_loop {
         return false;
     }
 
-    TimerEvent::TimerEvent(EventId id, std::chrono::nanoseconds duration, TimerEvent::Callback callback)
-        : Event(id),
+    TimerEvent::TimerEvent(EventId id, std::chrono::nanoseconds duration, std::chrono::nanoseconds slack, TimerEvent::Callback callback)
+        : TypedEvent(id),
           startTime(Clock::now()),
           duration(duration),
+          slack(slack),
           callback(std::move(callback)) {
 
     }
 
+    TimerEvent::Clock::time_point TimerEvent::deadline() const {
+        return startTime + duration;
+    }
+
     std::string TimerEvent::name() const {
         return "Timer";
     }
@@ -44,18 +72,31 @@ namespace event_loop {
             auto elapsedSeconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / 1.0E9;
             if (callback(context, { elapsedSeconds })) {
                 startTime = Clock::now();
-                context.eventLoop.timer(*this, nullptr);
-                return true;
+                return context.eventLoop.timer(*this, nullptr).hasValue();
             } else {
                 return false;
             }
         } else {
             // Deadline has not passed (due to other event), reschedule the event
-            context.eventLoop.timer(*this, nullptr);
-            return true;
+            return context.eventLoop.timer(*this, nullptr).hasValue();
         }
     }
 
+    TimerWakeupEvent::TimerWakeupEvent(EventId id, TimerEvent::Clock::time_point wakeupTime)
+        : TypedEvent(id),
+          wakeupTime(wakeupTime) {
+
+    }
+
+    std::string TimerWakeupEvent::name() const {
+        return "TimerWakeup";
+    }
+
+    bool TimerWakeupEvent::handle(EventContext& context) {
+        context.eventLoop.expireSlackTimers(context, id);
+        return false;
+    }
+
     SocketAddress defaultFor(SocketType type) {
         switch (type) {
             case SocketType::Inet:
@@ -67,10 +108,15 @@ namespace event_loop {
         }
     }
 
-    AcceptEvent::AcceptEvent(EventId id, Socket server, SocketType type, Callback callback)
-        : Event(id),
+    bool AdmissionOptions::enabled() const {
+        return maxConnections > 0 || maxLoopLatency || maxBufferMemory;
+    }
+
+    AcceptEvent::AcceptEvent(EventId id, Socket server, SocketType type, AdmissionOptions admission, Callback callback)
+        : TypedEvent(id),
           server(server),
           clientAddress(defaultFor(type)),
+          admission(admission),
           callback(std::move(callback)) {
 
     }
@@ -84,20 +130,24 @@ namespace event_loop {
             return false;
         }
 
+        if (context.result > 0 && admission.enabled() && !context.eventLoop.admitConnection(*this, Socket { context.result })) {
+            clientAddress = {};
+            return context.eventLoop.rearmAccept(*this).hasValue();
+        }
+
         if (callback(context, { Socket { context.result }, clientAddress }) && context.result > 0) {
             // Zero the data
             clientAddress = {};
 
-            // Reuse
-            context.eventLoop.accept(*this, nullptr);
-            return true;
+            // Reuse (unless paused by admission control), the event is removed if it cannot be resubmitted
+            return context.eventLoop.rearmAccept(*this).hasValue();
         }
 
         return false;
     }
 
     ConnectEvent::ConnectEvent(EventId id, Socket client, sockaddr_in serverAddress, ConnectEvent::Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           client(client),
           serverAddress(serverAddress),
           callback(std::move(callback)) {
@@ -105,7 +155,7 @@ namespace event_loop {
     }
 
     ConnectEvent::ConnectEvent(EventId id, Socket client, sockaddr_un serverAddress, ConnectEvent::Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           client(client),
           serverAddress(serverAddress),
           callback(std::move(callback))  {
@@ -134,7 +184,7 @@ namespace event_loop {
     }
 
     ReceiveEvent::ReceiveEvent(EventId id, Socket client, Buffer buffer, Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           client(client), buffer(std::move(buffer)),
           callback(std::move(callback)) {
 
@@ -153,16 +203,249 @@ namespace event_loop {
             // Zero the data
             buffer.clear();
 
-            // Reuse
-            context.eventLoop.receive(*this, nullptr);
-            return true;
+            // Reuse, the event is removed if it cannot be resubmitted
+            return context.eventLoop.receive(*this, nullptr).hasValue();
         }
 
         return false;
     }
 
+    void ReceiveStreamEvent::Response::consume(std::size_t size) const {
+        ring.consume(size);
+    }
+
+    ReceiveStreamEvent::ReceiveStreamEvent(EventId id, Socket client, std::unique_ptr<MirroredRingBuffer> ring, Callback callback)
+        : TypedEvent(id),
+          client(client), ring(std::move(ring)),
+          callback(std::move(callback)) {
+
+    }
+
+    std::string ReceiveStreamEvent::name() const {
+        return "ReceiveStream";
+    }
+
+    bool ReceiveStreamEvent::handle(EventContext& context) {
+        if (!callback) {
+            return false;
+        }
+
+        if (context.result > 0) {
+            ring->commit(context.resultAsSize());
+        }
+
+        if (!callback(context, { client, context.resultAsSize(), ring->readable(), *ring }) || context.result <= 0) {
+            return false;
+        }
+
+        if (ring->writable().empty()) {
+            // Nothing more can be received until data is consumed, which the callback is told about.
+            // Stops unless it made room.
+            EventContext fullContext { context.eventLoop, context.stopSource, -ENOBUFS, context.flags, context.arena };
+            if (!callback(fullContext, { client, 0, ring->readable(), *ring }) || ring->writable().empty()) {
+                return false;
+            }
+        }
+
+        // Reuse, the event is removed if it cannot be resubmitted
+        return context.eventLoop.receiveStream(*this, nullptr).hasValue();
+    }
+
+    ReceiveDatagramsEvent::ReceiveDatagramsEvent(EventId id, Socket socket, std::unique_ptr<ProvidedBufferRing> bufferRing, Callback callback)
+        : TypedEvent(id),
+          socket(socket), bufferRing(std::move(bufferRing)),
+          callback(std::move(callback)) {
+        // Only the lengths are used by multishot receives, telling the kernel how much space to reserve in each buffer
+        header.msg_namelen = sizeof(sockaddr_in);
+        header.msg_controllen = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(int));
+    }
+
+    std::string ReceiveDatagramsEvent::name() const {
+        return "ReceiveDatagrams";
+    }
+
+    bool ReceiveDatagramsEvent::handle(EventContext& context) {
+        if (!callback) {
+            return false;
+        }
+
+        if (cancelled) {
+            if ((context.flags & IORING_CQE_F_BUFFER) != 0) {
+                bufferRing->recycle((std::uint16_t)(context.flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+
+            return context.hasMore();
+        }
+
+        if (context.result < 0) {
+            if (context.result == -ENOBUFS) {
+                // All buffers were in use, receive again now that they have been returned
+                return context.eventLoop.receiveDatagrams(*this, nullptr).hasValue();
+            }
+
+            callback(context, { socket });
+            return false;
+        }
+
+        auto bufferId = (std::uint16_t)(context.flags >> IORING_CQE_BUFFER_SHIFT);
+        auto keep = handleDatagrams(context, bufferRing->buffer(bufferId));
+        bufferRing->recycle(bufferId);
+
+        if (!keep) {
+            if (!context.hasMore()) {
+                return false;
+            }
+
+            // The buffer ring must stay registered until the final completion
+            cancelled = true;
+            static_cast<void>(context.eventLoop.cancel(id, nullptr));
+            return true;
+        }
+
+        if (!context.hasMore()) {
+            // The kernel ends multishot receives when completions overflow, where re-arming is deferred
+            return context.eventLoop.rearm(*this, [](EventLoop& eventLoop, Event& event) {
+                return eventLoop.receiveDatagrams(static_cast<ReceiveDatagramsEvent&>(event), nullptr);
+            });
+        }
+
+        return true;
+    }
+
+    bool ReceiveDatagramsEvent::handleDatagrams(EventContext& context, std::uint8_t* buffer) {
+        auto message = io_uring_recvmsg_validate(buffer, context.result, &header);
+        if (message == nullptr) {
+            return true;
+        }
+
+        Response response { socket };
+
+        sockaddr_in source {};
+        std::memcpy(&source, io_uring_recvmsg_name(message), std::min((std::size_t)message->namelen, sizeof(source)));
+        response.source = source;
+
+        for (auto controlMessage = io_uring_recvmsg_cmsg_firsthdr(message, &header);
+             controlMessage != nullptr;
+             controlMessage = io_uring_recvmsg_cmsg_nexthdr(message, &header, controlMessage)) {
+            if (controlMessage->cmsg_level == SOL_SOCKET && controlMessage->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec timestamp {};
+                std::memcpy(&timestamp, CMSG_DATA(controlMessage), sizeof(timestamp));
+                response.timestamp = timestamp;
+            } else if (controlMessage->cmsg_level == SOL_UDP && controlMessage->cmsg_type == UDP_GRO) {
+                int segmentSize = 0;
+                std::memcpy(&segmentSize, CMSG_DATA(controlMessage), sizeof(segmentSize));
+                response.segmentSize = (std::uint16_t)segmentSize;
+            }
+        }
+
+        response.truncated = (message->flags & MSG_TRUNC) != 0;
+
+        auto payload = (std::uint8_t*)io_uring_recvmsg_payload(message, &header);
+        auto payloadSize = (std::size_t)io_uring_recvmsg_payload_length(message, context.result, &header);
+
+        // Coalesced datagrams are delivered one by one
+        std::size_t segmentSize = response.segmentSize ? *response.segmentSize : payloadSize;
+        std::size_t offset = 0;
+        do {
+            response.data = payload + offset;
+            response.size = std::min(segmentSize, payloadSize - offset);
+            if (!callback(context, response)) {
+                return false;
+            }
+
+            offset += response.size;
+        } while (offset < payloadSize && segmentSize > 0);
+
+        return true;
+    }
+
+    SignalEvent::SignalEvent(EventId id, File file)
+        : TypedEvent(id),
+          file(file) {
+
+    }
+
+    std::string SignalEvent::name() const {
+        return "Signal";
+    }
+
+    bool SignalEvent::handle(EventContext& context) {
+        if (context.result < 0) {
+            return context.result == -EINTR && context.eventLoop.readSignals(*this, nullptr).hasValue();
+        }
+
+        // Repeated signals in the same read are coalesced into a single call, in the order they first arrived
+        auto received = context.resultAsSize() / sizeof(signalfd_siginfo);
+        for (std::size_t index = 0; index < received; index++) {
+            auto signal = signals[index].ssi_signo;
+            if (signal == 0) {
+                continue;
+            }
+
+            SignalEvent::Response response { signals[index], 1 };
+            for (auto next = index + 1; next < received; next++) {
+                if (signals[next].ssi_signo == signal) {
+                    response.info = signals[next];
+                    response.count++;
+                    signals[next].ssi_signo = 0;
+                }
+            }
+
+            context.eventLoop.handleSignal(context, response);
+        }
+
+        // Reuse, the event is removed if it cannot be resubmitted
+        return context.eventLoop.readSignals(*this, nullptr).hasValue();
+    }
+
+    WatchEvent::WatchEvent(EventId id, File file)
+        : TypedEvent(id),
+          file(file) {
+
+    }
+
+    std::string WatchEvent::name() const {
+        return "Watch";
+    }
+
+    bool WatchEvent::handle(EventContext& context) {
+        if (context.result < 0) {
+            return context.result == -EINTR && context.eventLoop.readWatches(*this, nullptr).hasValue();
+        }
+
+        // Consecutive identical events (e.g. a burst of writes) are coalesced into a single call
+        std::optional<Response> pending;
+        auto end = buffer + context.resultAsSize();
+        for (auto current = buffer; current < end;) {
+            auto event = (const inotify_event*)current;
+            current += sizeof(inotify_event) + event->len;
+
+            Response response { event->wd, event->mask, event->cookie, { event->name, strnlen(event->name, event->len) }, 1 };
+            if (pending
+                && pending->watchDescriptor == response.watchDescriptor
+                && pending->mask == response.mask
+                && pending->name == response.name) {
+                pending->count++;
+                continue;
+            }
+
+            if (pending) {
+                context.eventLoop.handleWatch(context, *pending);
+            }
+
+            pending = response;
+        }
+
+        if (pending) {
+            context.eventLoop.handleWatch(context, *pending);
+        }
+
+        // Reuse, the event is removed if it cannot be resubmitted
+        return context.eventLoop.readWatches(*this, nullptr).hasValue();
+    }
+
     SendEvent::SendEvent(EventId id, Socket client, Buffer data, Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           client(client), data(std::move(data)),
           callback(std::move(callback)) {
 
@@ -181,8 +464,68 @@ namespace event_loop {
         return false;
     }
 
+    SendToEvent::SendToEvent(EventId id, Socket socket, SocketAddress destination, std::pmr::vector<Buffer> datagrams, Callback callback)
+        : TypedEvent(id),
+          socket(socket), destination(destination), datagrams(std::move(datagrams)), dataVectors(this->datagrams.get_allocator()),
+          callback(std::move(callback)) {
+        dataVectors.reserve(this->datagrams.size());
+        for (auto& datagram : this->datagrams) {
+            dataVectors.push_back(iovec { datagram.data(), datagram.size() });
+        }
+
+        std::visit([&](auto& address) {
+            header.msg_name = &address;
+            header.msg_namelen = sizeof(address);
+        }, this->destination);
+
+        header.msg_iov = dataVectors.data();
+        header.msg_iovlen = dataVectors.size();
+
+        if (this->datagrams.size() > 1) {
+            header.msg_control = control;
+            header.msg_controllen = sizeof(control);
+
+            auto controlMessage = CMSG_FIRSTHDR(&header);
+            controlMessage->cmsg_level = SOL_UDP;
+            controlMessage->cmsg_type = UDP_SEGMENT;
+            controlMessage->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+
+            auto segmentSize = (std::uint16_t)this->datagrams.front().size();
+            std::memcpy(CMSG_DATA(controlMessage), &segmentSize, sizeof(segmentSize));
+        }
+    }
+
+    std::string SendToEvent::name() const {
+        return "SendTo";
+    }
+
+    bool SendToEvent::handle(EventContext& context) {
+        if (!callback) {
+            return false;
+        }
+
+        // Segmentation offload not supported by the socket or device, or the segments exceed the path MTU.
+        // Sent again as one message per datagram.
+        if (datagrams.size() > 1 && (context.result == -EINVAL || context.result == -EIO)) {
+            SubmitGuard submit(context.eventLoop);
+            for (std::size_t index = 0; index < datagrams.size(); index++) {
+                auto result = context.eventLoop.trySendTo(socket, destination, datagrams[index], callback, &submit);
+                if (!result) {
+                    EventContext failedContext { context.eventLoop, context.stopSource, -result.error().errorCode(), context.flags, context.arena };
+                    callback(failedContext, { socket, destination, 0, datagrams.size() - index });
+                    break;
+                }
+            }
+
+            return false;
+        }
+
+        callback(context, { socket, destination, context.resultAsSize(), datagrams.size() });
+        return false;
+    }
+
     OpenFileEvent::OpenFileEvent(EventId id, std::filesystem::path path, int flags, mode_t mode, OpenFileEvent::Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           path(std::move(path)), flags(flags), mode(mode),
           callback(std::move(callback)) {
 
@@ -202,7 +545,7 @@ namespace event_loop {
     }
 
     ReadFileEvent::ReadFileEvent(EventId id, File file, Buffer buffer, std::uint64_t offset, ReadFileEvent::Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           file(file), buffer(std::move(buffer)), offset(offset),
           callback(std::move(callback)) {
 
@@ -223,16 +566,15 @@ namespace event_loop {
             // Zero the data
             buffer.clear();
 
-            // Reuse
-            context.eventLoop.readFile(*this, nullptr);
-            return true;
+            // Reuse, the event is removed if it cannot be resubmitted
+            return context.eventLoop.readFile(*this, nullptr).hasValue();
         }
 
         return false;
     }
 
     WriteFileEvent::WriteFileEvent(EventId id, File file, Buffer data, Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           file(file), data(std::move(data)),
           callback(std::move(callback)) {
 
@@ -252,7 +594,7 @@ namespace event_loop {
     }
 
     ReadFileStatsEvent::ReadFileStatsEvent(EventId id, std::filesystem::path path, ReadFileStatsEvent::Callback callback)
-        : Event(id),
+        : TypedEvent(id),
           path(std::move(path)),
           callback(std::move(callback))
     {
@@ -4,22 +4,52 @@
 #include <cstdint>
 #include <filesystem>
 #include <variant>
+#include <optional>
+#include <chrono>
+#include <vector>
+#include <memory_resource>
+#include <string_view>
+#include <span>
 
 #include <netinet/in.h>
 #include <sys/un.h>
 #include <linux/time_types.h>
 #include <sys/stat.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "common.h"
 #include "buffer.h"
+#include "memory.h"
+#include "buffer_ring.h"
+#include "mirrored_ring.h"
 
 template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
 template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
 
 namespace event_loop {
-    struct CloseEvent : public Event {
+    struct NopEvent : public TypedEvent<NopEvent> {
+        struct Response {
+
+        };
+
+        using Callback = std::function<void (EventContext& context, const Response&)>;
+        Callback callback;
+
+        NopEvent(EventId id, Callback callback);
+
+        std::string name() const override;
+        bool handle(EventContext& context);
+    };
+
+    struct CloseEvent : public TypedEvent<CloseEvent> {
         AnyFd fd;
 
+        // The arena of the connection, released when the close has completed
+        ConnectionArenaPointer arena;
+
         struct Response {
             AnyFd fd;
         };
@@ -30,16 +60,19 @@ namespace event_loop {
         CloseEvent(EventId id, AnyFd fd, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
     };
 
-    struct TimerEvent : public Event {
+    struct TimerEvent : public TypedEvent<TimerEvent> {
         using Clock = std::chrono::high_resolution_clock;
 
         Clock::time_point startTime;
         std::chrono::nanoseconds duration;
         __kernel_timespec eventDelay {};
 
+        // How much later than the duration the timer is allowed to fire, letting it share wakeups with other timers
+        std::chrono::nanoseconds slack { 0 };
+
         struct Response {
             double elapsed = 0.0;
         };
@@ -47,10 +80,25 @@ namespace event_loop {
         using Callback = std::function<bool (EventContext& context, const Response&)>;
         Callback callback;
 
-        TimerEvent(EventId id, std::chrono::nanoseconds duration, Callback callback);
+        TimerEvent(EventId id, std::chrono::nanoseconds duration, std::chrono::nanoseconds slack, Callback callback);
+
+        Clock::time_point deadline() const;
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
+    };
+
+    /**
+     * Single wakeup shared by all timers with slack (see EventLoop::timer)
+     */
+    struct TimerWakeupEvent : public TypedEvent<TimerWakeupEvent> {
+        TimerEvent::Clock::time_point wakeupTime;
+        __kernel_timespec eventDelay {};
+
+        TimerWakeupEvent(EventId id, TimerEvent::Clock::time_point wakeupTime);
+
+        std::string name() const override;
+        bool handle(EventContext& context);
     };
 
     enum class SocketType {
@@ -61,12 +109,37 @@ namespace event_loop {
     using SocketAddress = std::variant<sockaddr_in, sockaddr_un>;
     SocketAddress defaultFor(SocketType type);
 
-    struct AcceptEvent : public Event {
+    struct AdmissionOptions {
+        // Maximum number of connections accepted by the listener that are not yet closed (through close or
+        // releaseConnection), zero for no limit
+        std::size_t maxConnections = 0;
+
+        // Pause accepting while the average time the loop spends handling an iteration is above this
+        std::optional<std::chrono::nanoseconds> maxLoopLatency;
+
+        // Pause accepting while the memory of buffers allocated by the loop is above this many bytes
+        std::optional<std::size_t> maxBufferMemory;
+
+        // Keep accepting but close connections above the limits right away, instead of leaving them in the backlog
+        bool reject = false;
+
+        // How often a paused listener checks if it can resume
+        std::chrono::nanoseconds resumeCheckInterval = std::chrono::milliseconds(10);
+
+        bool enabled() const;
+    };
+
+    struct AcceptEvent : public TypedEvent<AcceptEvent> {
         Socket server;
 
         SocketAddress clientAddress;
         socklen_t clientAddressLength = sizeof(socklen_t);
 
+        AdmissionOptions admission;
+        std::size_t connections = 0;
+        bool paused = false;
+        bool resumeCheckArmed = false;
+
         struct Response {
             Socket client;
             SocketAddress clientAddress {};
@@ -75,13 +148,13 @@ namespace event_loop {
         using Callback = std::function<bool (EventContext& context, const Response&)>;
         Callback callback;
 
-        AcceptEvent(EventId id, Socket server, SocketType type, Callback callback);
+        AcceptEvent(EventId id, Socket server, SocketType type, AdmissionOptions admission, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
     };
 
-    struct ConnectEvent : public Event {
+    struct ConnectEvent : public TypedEvent<ConnectEvent> {
         Socket client;
         SocketAddress serverAddress;
 
@@ -101,10 +174,10 @@ namespace event_loop {
         ConnectEvent(EventId id, Socket client, sockaddr_un serverAddress, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
     };
 
-    struct ReceiveEvent : public Event {
+    struct ReceiveEvent : public TypedEvent<ReceiveEvent> {
         Socket client;
         Buffer buffer;
 
@@ -120,10 +193,155 @@ namespace event_loop {
         ReceiveEvent(EventId id, Socket client, Buffer buffer, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
+    };
+
+    /**
+     * Receives a stream into a ring of the given capacity. When the ring is full, the callback is called again with the
+     * result -ENOBUFS (and a size of zero), where it must consume data to keep receiving.
+     */
+    struct ReceiveStreamEvent : public TypedEvent<ReceiveStreamEvent> {
+        Socket client;
+        std::unique_ptr<MirroredRingBuffer> ring;
+
+        struct Response {
+            Socket client;
+
+            // Number of bytes received by this receive, zero when the connection is closed
+            std::size_t size = 0;
+
+            // All received data not yet consumed, always contiguous
+            std::span<const std::uint8_t> data;
+
+            MirroredRingBuffer& ring;
+
+            /**
+             * Marks the given number of bytes at the start of the data as processed
+             */
+            void consume(std::size_t size) const;
+        };
+
+        using Callback = std::function<bool (EventContext& context, const Response&)>;
+        Callback callback;
+
+        ReceiveStreamEvent(EventId id, Socket client, std::unique_ptr<MirroredRingBuffer> ring, Callback callback);
+
+        std::string name() const override;
+        bool handle(EventContext& context);
+    };
+
+    struct SignalEvent : public TypedEvent<SignalEvent> {
+        File file;
+        signalfd_siginfo signals[16] {};
+
+        struct Response {
+            // The last received instance of the signal
+            signalfd_siginfo info {};
+
+            // Number of times the signal was received since the callback was last called
+            std::size_t count = 0;
+        };
+
+        using Callback = std::function<bool (EventContext& context, const Response&)>;
+
+        SignalEvent(EventId id, File file);
+
+        std::string name() const override;
+        bool handle(EventContext& context);
     };
 
-    struct SendEvent : public Event {
+    struct WatchEvent : public TypedEvent<WatchEvent> {
+        File file;
+        alignas(inotify_event) std::uint8_t buffer[4096] {};
+
+        struct Response {
+            int watchDescriptor = -1;
+            std::uint32_t mask = 0;
+            std::uint32_t cookie = 0;
+
+            // Name of the file within a watched directory, points into the read buffer
+            std::string_view name;
+
+            // Number of identical events coalesced into this one
+            std::size_t count = 0;
+        };
+
+        using Callback = std::function<bool (EventContext& context, const Response&)>;
+
+        WatchEvent(EventId id, File file);
+
+        std::string name() const override;
+        bool handle(EventContext& context);
+    };
+
+    struct ReusePortOptions {
+        // Allow one socket per event loop to bind the same port (SO_REUSEPORT)
+        bool enabled = false;
+
+        // If non-zero, attach a BPF program selecting the socket by the CPU receiving the packet (modulo the group size).
+        // The sockets must then be bound in CPU order, each served by a loop pinned to that CPU.
+        std::uint32_t cpuGroupSize = 0;
+    };
+
+    struct TcpListenOptions {
+        int backlog = 32;
+        ReusePortOptions reusePort;
+    };
+
+    struct UdpReceiverOptions {
+        // Receive the kernel timestamp of each datagram (SO_TIMESTAMPNS)
+        bool receiveTimestamps = false;
+
+        // Let the kernel coalesce datagrams of the same flow into one receive (UDP_GRO)
+        bool genericReceiveOffload = false;
+
+        ReusePortOptions reusePort;
+    };
+
+    struct ReceiveDatagramsOptions {
+        // Number of buffers provided to the kernel, must be a power of two
+        std::uint32_t bufferCount = 256;
+
+        // Size of each buffer, holding the source address, ancillary data and payload. Should be 64 KB when using UDP_GRO.
+        std::size_t bufferSize = 2048;
+    };
+
+    struct ReceiveDatagramsEvent : public TypedEvent<ReceiveDatagramsEvent> {
+        Socket socket;
+        std::unique_ptr<ProvidedBufferRing> bufferRing;
+        msghdr header {};
+
+        // Stopped by the callback, kept until the kernel has posted the last completion using the buffer ring
+        bool cancelled = false;
+
+        struct Response {
+            Socket socket;
+            SocketAddress source {};
+            std::uint8_t* data = nullptr;
+            std::size_t size = 0;
+
+            // The kernel receive timestamp, if enabled
+            std::optional<timespec> timestamp;
+
+            // The segment size if the datagram was coalesced by UDP_GRO
+            std::optional<std::uint16_t> segmentSize;
+
+            // If the datagram did not fit in the buffer
+            bool truncated = false;
+        };
+
+        using Callback = std::function<bool (EventContext& context, const Response&)>;
+        Callback callback;
+
+        ReceiveDatagramsEvent(EventId id, Socket socket, std::unique_ptr<ProvidedBufferRing> bufferRing, Callback callback);
+
+        std::string name() const override;
+        bool handle(EventContext& context);
+    private:
+        bool handleDatagrams(EventContext& context, std::uint8_t* buffer);
+    };
+
+    struct SendEvent : public TypedEvent<SendEvent> {
         Socket client;
         Buffer data;
 
@@ -138,10 +356,44 @@ namespace event_loop {
         SendEvent(EventId id, Socket client, Buffer data, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
+    };
+
+    struct Datagram {
+        SocketAddress destination;
+        Buffer data;
+    };
+
+    struct SendToEvent : public TypedEvent<SendToEvent> {
+        Socket socket;
+        SocketAddress destination;
+        std::pmr::vector<Buffer> datagrams;
+
+        std::pmr::vector<iovec> dataVectors;
+        msghdr header {};
+        alignas(cmsghdr) std::uint8_t control[CMSG_SPACE(sizeof(std::uint16_t))] {};
+
+        struct Response {
+            Socket socket;
+            SocketAddress destination;
+            std::size_t size = 0;
+            std::size_t datagrams = 0;
+        };
+
+        using Callback = std::function<void (EventContext& context, const Response&)>;
+        Callback callback;
+
+        /**
+         * Sends the given datagrams in a single message, using UDP segmentation offload (UDP_SEGMENT) if more than one.
+         * All datagrams except the last must be of the same size.
+         */
+        SendToEvent(EventId id, Socket socket, SocketAddress destination, std::pmr::vector<Buffer> datagrams, Callback callback);
+
+        std::string name() const override;
+        bool handle(EventContext& context);
     };
 
-    struct OpenFileEvent : public Event {
+    struct OpenFileEvent : public TypedEvent<OpenFileEvent> {
         std::filesystem::path path;
         int flags = 0;
         mode_t mode = 0;
@@ -156,10 +408,10 @@ namespace event_loop {
         OpenFileEvent(EventId id, std::filesystem::path path, int flags, mode_t mode, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
     };
 
-    struct ReadFileEvent : public Event {
+    struct ReadFileEvent : public TypedEvent<ReadFileEvent> {
         File file;
         std::uint64_t offset = 0;
         Buffer buffer;
@@ -177,10 +429,10 @@ namespace event_loop {
         ReadFileEvent(EventId id, File file, Buffer buffer, std::uint64_t offset, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
     };
 
-    struct WriteFileEvent : public Event {
+    struct WriteFileEvent : public TypedEvent<WriteFileEvent> {
         File file;
         Buffer data;
 
@@ -195,10 +447,10 @@ namespace event_loop {
         WriteFileEvent(EventId id, File file, Buffer data, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
     };
 
-    struct ReadFileStatsEvent : public Event {
+    struct ReadFileStatsEvent : public TypedEvent<ReadFileStatsEvent> {
         std::filesystem::path path;
         int flags = 0;
         unsigned int mask = 0;
@@ -214,7 +466,7 @@ namespace event_loop {
         ReadFileStatsEvent(EventId id, std::filesystem::path path, Callback callback);
 
         std::string name() const override;
-        bool handle(EventContext& context) override;
+        bool handle(EventContext& context);
     };
 
     struct ReadLineEvent {
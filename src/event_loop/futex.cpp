@@ -0,0 +1,36 @@
+#include "futex.h"
+
+#include <cerrno>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace event_loop {
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "Futex words must be 32 bits.");
+
+    bool futexWait(std::atomic<std::uint32_t>& word, std::uint32_t expected, std::optional<std::chrono::nanoseconds> timeout, bool shared) {
+        timespec timeoutSpec {};
+        if (timeout) {
+            auto nanoseconds = std::max(timeout->count(), (std::int64_t)0);
+            timeoutSpec.tv_sec = nanoseconds / std::chrono::nanoseconds::period::den;
+            timeoutSpec.tv_nsec = nanoseconds % std::chrono::nanoseconds::period::den;
+        }
+
+        auto result = syscall(
+            SYS_futex,
+            (std::uint32_t*)&word,
+            shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE,
+            expected,
+            timeout ? &timeoutSpec : nullptr,
+            nullptr,
+            0
+        );
+
+        return !(result < 0 && errno == ETIMEDOUT);
+    }
+
+    void futexWake(std::atomic<std::uint32_t>& word, int count, bool shared) {
+        syscall(SYS_futex, (std::uint32_t*)&word, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+}
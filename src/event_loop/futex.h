@@ -0,0 +1,21 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <optional>
+
+namespace event_loop {
+    /**
+     * Blocks the calling thread while the given word has the expected value.
+     * Returns false if the timeout passed before being woken up, spurious wakeups are possible.
+     * Shared futexes can be waited on and woken up across processes (the word is in shared memory).
+     */
+    bool futexWait(std::atomic<std::uint32_t>& word, std::uint32_t expected, std::optional<std::chrono::nanoseconds> timeout = {}, bool shared = false);
+
+    /**
+     * Wakes up at most the given number of threads waiting on the given word
+     */
+    void futexWake(std::atomic<std::uint32_t>& word, int count = INT_MAX, bool shared = false);
+}
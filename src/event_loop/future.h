@@ -0,0 +1,323 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "futex.h"
+
+namespace event_loop {
+    class EventLoop;
+
+    template<typename T>
+    class DispatchFuture;
+
+    /**
+     * Requests the given callback to be executed on the given event loop (see EventLoop::dispatch)
+     */
+    void dispatchOn(EventLoop& eventLoop, std::function<void (EventLoop&)> callback);
+
+    /**
+     * The shared state between a dispatched task and its future.
+     * The state is reference counted by the future and the task, completion is signaled through the state word.
+     */
+    template<typename T>
+    class DispatchResultState {
+    public:
+        using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+        using Continuation = std::function<void (EventLoop& eventLoop, DispatchFuture<T>& future)>;
+
+        static constexpr std::uint32_t Ready = 1 << 0;
+        static constexpr std::uint32_t HasContinuation = 1 << 1;
+        static constexpr std::uint32_t HasWaiter = 1 << 2;
+    private:
+        std::atomic<std::uint32_t> mReferences { 2 };
+    public:
+        std::atomic<std::uint32_t> state { 0 };
+        std::optional<Value> value;
+        std::exception_ptr error;
+
+        EventLoop* continuationEventLoop = nullptr;
+        Continuation continuation;
+
+        virtual ~DispatchResultState() = default;
+
+        void retain() {
+            mReferences.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release() {
+            if (mReferences.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+
+        void complete() {
+            auto previous = state.fetch_or(Ready, std::memory_order_acq_rel);
+
+            if ((previous & HasWaiter) != 0) {
+                futexWake(state);
+            }
+
+            if ((previous & HasContinuation) != 0) {
+                scheduleContinuation();
+            }
+        }
+
+        void scheduleContinuation();
+    };
+
+    /**
+     * The task executed on the event loop, storing the function inline to only require a single allocation
+     */
+    template<typename T, typename Function>
+    class DispatchTask : public DispatchResultState<T> {
+    private:
+        Function mFunction;
+
+        // References held by dispatched callbacks, the task is abandoned if the last one goes away without running it
+        std::atomic<std::uint32_t> mDispatchReferences { 1 };
+    public:
+        explicit DispatchTask(Function function)
+            : mFunction(std::move(function)) {
+
+        }
+
+        void retainDispatch() {
+            mDispatchReferences.fetch_add(1, std::memory_order_relaxed);
+            this->retain();
+        }
+
+        void releaseDispatch() {
+            if (mDispatchReferences.fetch_sub(1, std::memory_order_acq_rel) == 1
+                && (this->state.load(std::memory_order_acquire) & DispatchResultState<T>::Ready) == 0) {
+                // Never run, as the event loop was destroyed first
+#if defined(__cpp_exceptions)
+                this->error = std::make_exception_ptr(std::runtime_error("The event loop was destroyed before running the dispatched function."));
+#endif
+                this->complete();
+            }
+
+            this->release();
+        }
+
+        void run(EventLoop& eventLoop) {
+#if defined(__cpp_exceptions)
+            try {
+                execute(eventLoop);
+            } catch (...) {
+                this->error = std::current_exception();
+            }
+#else
+            execute(eventLoop);
+#endif
+
+            this->complete();
+        }
+    private:
+        void execute(EventLoop& eventLoop) {
+            if constexpr (std::is_void_v<T>) {
+                mFunction(eventLoop);
+                this->value.emplace();
+            } else {
+                this->value.emplace(mFunction(eventLoop));
+            }
+        }
+    };
+
+    /**
+     * Reference to a task held by its dispatched callback. Completes the future with an error if the callback is
+     * destroyed without having run, so that the task is not leaked and waiters are woken up.
+     */
+    template<typename T, typename Function>
+    class DispatchTaskReference {
+    private:
+        DispatchTask<T, Function>* mTask;
+    public:
+        explicit DispatchTaskReference(DispatchTask<T, Function>* task)
+            : mTask(task) {
+
+        }
+
+        DispatchTaskReference(const DispatchTaskReference& other)
+            : mTask(other.mTask) {
+            mTask->retainDispatch();
+        }
+
+        DispatchTaskReference& operator=(const DispatchTaskReference&) = delete;
+
+        ~DispatchTaskReference() {
+            mTask->releaseDispatch();
+        }
+
+        void operator()(EventLoop& eventLoop) const {
+            mTask->run(eventLoop);
+        }
+    };
+
+    /**
+     * Lightweight future for the result of a dispatched callback
+     */
+    template<typename T>
+    class DispatchFuture {
+    private:
+        using State = DispatchResultState<T>;
+        State* mState = nullptr;
+    public:
+        DispatchFuture() = default;
+
+        explicit DispatchFuture(State* state)
+            : mState(state) {
+
+        }
+
+        ~DispatchFuture() {
+            if (mState != nullptr) {
+                mState->release();
+            }
+        }
+
+        DispatchFuture(const DispatchFuture&) = delete;
+        DispatchFuture& operator=(const DispatchFuture&) = delete;
+
+        DispatchFuture(DispatchFuture&& other) noexcept
+            : mState(std::exchange(other.mState, nullptr)) {
+
+        }
+
+        DispatchFuture& operator=(DispatchFuture&& other) noexcept {
+            if (&other != this) {
+                if (mState != nullptr) {
+                    mState->release();
+                }
+
+                mState = std::exchange(other.mState, nullptr);
+            }
+
+            return *this;
+        }
+
+        bool valid() const {
+            return mState != nullptr;
+        }
+
+        bool ready() const {
+            return mState != nullptr && (mState->state.load(std::memory_order_acquire) & State::Ready) != 0;
+        }
+
+        /**
+         * Blocks until the result is available
+         */
+        void wait() const {
+            waitFor({});
+        }
+
+        /**
+         * Blocks until the result is available or the timeout has passed. Returns true if the result is available.
+         */
+        bool waitFor(std::optional<std::chrono::nanoseconds> timeout) const {
+            using Clock = std::chrono::steady_clock;
+            auto deadline = timeout ? Clock::now() + *timeout : Clock::time_point::max();
+
+            if (mState == nullptr) {
+                return false;
+            }
+
+            while (true) {
+                auto current = mState->state.fetch_or(State::HasWaiter, std::memory_order_acq_rel) | State::HasWaiter;
+                if ((current & State::Ready) != 0) {
+                    return true;
+                }
+
+                std::optional<std::chrono::nanoseconds> remaining;
+                if (timeout) {
+                    remaining = deadline - Clock::now();
+                    if (remaining->count() <= 0) {
+                        return ready();
+                    }
+                }
+
+                futexWait(mState->state, current, remaining);
+            }
+        }
+
+        /**
+         * Blocks until the result is available and returns it. Rethrows if the dispatched callback threw.
+         */
+        decltype(auto) get() {
+            wait();
+
+#if defined(__cpp_exceptions)
+            if (mState->error) {
+                std::rethrow_exception(mState->error);
+            }
+#endif
+
+            // Without exceptions, an abandoned task (see DispatchTask::releaseDispatch) has no value to report
+            if (!mState->value) {
+                std::terminate();
+            }
+
+            if constexpr (!std::is_void_v<T>) {
+                return static_cast<T&>(*mState->value);
+            }
+        }
+
+        /**
+         * Executes the given callback on the given event loop when the result is available.
+         * The future is moved into the continuation, so it can no longer be used after this call. Does nothing for an
+         * empty future.
+         */
+        void then(EventLoop& eventLoop, typename State::Continuation continuation) {
+            if (mState == nullptr) {
+                return;
+            }
+
+            auto state = std::exchange(mState, nullptr);
+            state->continuationEventLoop = &eventLoop;
+            state->continuation = std::move(continuation);
+
+            auto previous = state->state.fetch_or(State::HasContinuation, std::memory_order_acq_rel);
+            if ((previous & State::Ready) != 0) {
+                state->scheduleContinuation();
+            }
+        }
+    };
+
+    template<typename T>
+    void DispatchResultState<T>::scheduleContinuation() {
+        // Owns the reference of the future, so it is released even if the event loop is destroyed before running it
+        struct Reference {
+            DispatchResultState<T>* state;
+
+            explicit Reference(DispatchResultState<T>* state)
+                : state(state) {
+
+            }
+
+            Reference(const Reference& other)
+                : state(other.state) {
+                state->retain();
+            }
+
+            Reference& operator=(const Reference&) = delete;
+
+            ~Reference() {
+                state->release();
+            }
+        };
+
+        dispatchOn(*continuationEventLoop, [reference = Reference { this }](EventLoop& eventLoop) {
+            reference.state->retain();
+            DispatchFuture<T> future { reference.state };
+            reference.state->continuation(eventLoop, future);
+        });
+    }
+}
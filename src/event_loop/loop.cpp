@@ -2,11 +2,66 @@
 #include "events.h"
 
 #include <fcntl.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
 
+#include <atomic>
 #include <mutex>
+#include <optional>
 
 namespace event_loop {
     namespace {
+        struct Follower {
+            File file;
+            std::uint64_t offset = 0;
+            Buffer buffer;
+            EventLoop::FollowCallback callback;
+
+            bool reading = false;
+            bool modifiedWhileReading = false;
+            bool stopped = false;
+
+            ~Follower() {
+                ::close(file.fd);
+            }
+        };
+
+        /**
+         * Reads the followed file from the last offset until the end, then again if it was modified in the meantime
+         */
+        void readAppended(EventLoop& eventLoop, std::shared_ptr<Follower> follower) {
+            // Truncated, start over
+            struct stat stats {};
+            if (::fstat(follower->file.fd, &stats) == 0 && (std::uint64_t)stats.st_size < follower->offset) {
+                follower->offset = 0;
+            }
+
+            auto result = eventLoop.tryReadFile(
+                follower->file,
+                follower->buffer,
+                follower->offset,
+                [follower](EventContext& context, const ReadFileEvent::Response& response) {
+                    if (response.size > 0 && !follower->stopped) {
+                        follower->offset += response.size;
+                        follower->stopped = !follower->callback(context, { response.data, response.size });
+                        return !follower->stopped;
+                    }
+
+                    follower->reading = false;
+                    if (follower->modifiedWhileReading && !follower->stopped) {
+                        follower->modifiedWhileReading = false;
+                        readAppended(context.eventLoop, follower);
+                    }
+
+                    return false;
+                }
+            );
+
+            follower->reading = result.hasValue();
+        }
+
         __kernel_timespec createKernelTimeSpec(std::chrono::nanoseconds delay) {
             __kernel_timespec timespec {};
 
@@ -17,6 +72,57 @@ namespace event_loop {
 
             return timespec;
         }
+
+        // Limits of a single message using UDP segmentation offload
+        constexpr std::size_t maxSegments = 64;
+        constexpr std::size_t maxSegmentedSize = 65507;
+
+        Expected<> configureReusePort(int socketFd, const ReusePortOptions& options) {
+            if (!options.enabled) {
+                return {};
+            }
+
+            int enable = 1;
+            auto result = checkSystemCall(setsockopt(socketFd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)), "setsockopt(SO_REUSEPORT)");
+            if (!result) {
+                return result.error();
+            }
+
+            if (options.cpuGroupSize == 0) {
+                return {};
+            }
+
+            // A = current CPU; A = A % group size; return A
+            sock_filter code[] = {
+                { BPF_LD | BPF_W | BPF_ABS, 0, 0, (std::uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+                { BPF_ALU | BPF_MOD | BPF_K, 0, 0, options.cpuGroupSize },
+                { BPF_RET | BPF_A, 0, 0, 0 },
+            };
+
+            sock_fprog program {};
+            program.len = sizeof(code) / sizeof(code[0]);
+            program.filter = code;
+
+            result = checkSystemCall(
+                setsockopt(socketFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)),
+                "setsockopt(SO_ATTACH_REUSEPORT_CBPF)"
+            );
+            if (!result) {
+                return result.error();
+            }
+
+            return {};
+        }
+
+        bool sameAddress(const SocketAddress& first, const SocketAddress& second) {
+            if (first.index() != second.index()) {
+                return false;
+            }
+
+            return std::visit([&](auto& address) {
+                return std::memcmp(&address, &std::get<std::decay_t<decltype(address)>>(second), sizeof(address)) == 0;
+            }, first);
+        }
     }
 
     TcpListener::TcpListener(Socket socket, sockaddr_in address)
@@ -53,7 +159,7 @@ namespace event_loop {
 
     SubmitGuard::~SubmitGuard() {
         if (mSubmitted > 0) {
-            mEventLoop.submitRing(nullptr);
+            static_cast<void>(mEventLoop.flushSubmissions());
             mSubmitted = 0;
         }
     }
@@ -62,12 +168,66 @@ namespace event_loop {
         mSubmitted++;
     }
 
-    EventLoop::EventLoop(std::uint32_t depth) {
-        EventLoopException::throwIfFailed(io_uring_queue_init(depth, &mRing, 0), "io_uring_queue_init");
+    void EventDeleter::operator()(Event* event) const {
+        event->~Event();
+        resource->deallocate(event, size, alignment);
+    }
+
+    EventLoop::EventLoop(std::uint32_t depth, std::size_t iterationArenaSize, std::pmr::memory_resource* resource)
+        : EventLoop(RingOptions { .depth = depth }, iterationArenaSize, resource) {
+
+    }
+
+    EventLoop::EventLoop(RingOptions ring, std::size_t iterationArenaSize, std::pmr::memory_resource* resource)
+        : mResource(resource),
+          mRingOptions(ring),
+          mBufferManager(resource),
+          mBufferGroupIds(resource),
+          mEvents(resource),
+          mDispatchQueue(resource),
+          mExecutingDispatched(resource),
+          mDispatchBatchPools(resource),
+          mIterationArena(iterationArenaSize, resource),
+          mConnectionArenas(resource),
+          mSlackTimers(resource),
+          mAdmittedConnections(resource),
+          mDeferredRearms(resource),
+          mSignalCallbacks(resource),
+          mWatchers(resource),
+          mFileStatsCache(resource),
+          mStatsWatchedDirectories(resource),
+          mStatsDirectoryGenerations(resource) {
+        auto params = ringParameters({ ring.depth, ring.completionQueueSize }, false);
+        EventLoopException::throwIfFailed(io_uring_queue_init_params(ring.depth, &mRing, &params), "io_uring_queue_init_params");
+        mLastCompletionOverflow = *mRing.cq.koverflow;
+
+        // Optional, not supported by older kernels. Unregistered by io_uring_queue_exit.
+        mRingFdRegistered = io_uring_register_ring_fd(&mRing) == 1;
     }
 
     EventLoop::~EventLoop() {
         io_uring_queue_exit(&mRing);
+
+        // The provided buffer rings of the events, destroyed with the members, were unregistered along with the ring
+        mBufferGroupIds.ringExited();
+
+        if (mSignalFile) {
+            ::close(mSignalFile.fd);
+
+            sigset_t handledSignals;
+            sigemptyset(&handledSignals);
+            for (int signal = 1; signal < NSIG; signal++) {
+                if (sigismember(&mSignalMask, signal) == 1 && sigismember(&mPreviouslyBlockedSignals, signal) != 1) {
+                    sigaddset(&handledSignals, signal);
+                }
+            }
+
+            pthread_sigmask(SIG_UNBLOCK, &handledSignals, nullptr);
+        }
+
+        if (mWatchFile) {
+            ::close(mWatchFile.fd);
+        }
     }
 
     void EventLoop::run(std::stop_source& stopSource) {
@@ -79,355 +239,1342 @@ namespace event_loop {
     }
 
     bool EventLoop::runOnce(std::stop_source& stopSource, std::chrono::duration<double> maxDuration) {
+        mMetrics.iterations++;
+
+        if (mStopSource != stopSource) {
+            mStopSource = stopSource;
+        }
+
+        checkCompletionOverflow();
+
+        auto waitDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(maxDuration);
+        if (mPendingSubmissions > 0) {
+            // Held operations must not wait longer than the batching delay
+            auto remaining = mFirstPendingSubmission + mSubmitBatching.maxDelay - std::chrono::steady_clock::now();
+            if (remaining <= std::chrono::nanoseconds(0)) {
+                flushSubmissions().valueOrThrow();
+            } else {
+                waitDuration = std::min(waitDuration, std::chrono::duration_cast<std::chrono::nanoseconds>(remaining));
+            }
+        }
+
         io_uring_cqe* cqe = nullptr;
-        auto delay = createKernelTimeSpec(std::chrono::duration_cast<std::chrono::nanoseconds>(maxDuration));
+        auto delay = createKernelTimeSpec(waitDuration);
         auto result = io_uring_wait_cqe_timeout(&mRing, &cqe, &delay);
-        if (result == -ETIME) {
+
+        std::chrono::steady_clock::time_point handleStart;
+        if (mTrackLoopLatency) {
+            handleStart = std::chrono::steady_clock::now();
+        }
+
+        auto finishIteration = [&]() {
             executeDispatched();
+            mIterationArena.reset();
+
+            if (mPendingSubmissions > 0 && std::chrono::steady_clock::now() - mFirstPendingSubmission >= mSubmitBatching.maxDelay) {
+                flushSubmissions().valueOrThrow();
+            }
+
+            if (mRingOptions.autoResize) {
+                checkRingSize();
+            }
+
+            if (mTrackLoopLatency) {
+                auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - handleStart);
+                mLoopLatency += (latency - mLoopLatency) / 8;
+            }
+        };
+
+        if (result == -ETIME || result == -EINTR) {
+            finishIteration();
             return false;
         }
 
         EventLoopException::throwIfFailed(result, "io_uring_wait_cqe_timeout");
 
+        if (mRingOptions.autoResize) {
+            mPeakCompletionQueue = std::max(mPeakCompletionQueue, io_uring_cq_ready(&mRing));
+        }
+
         auto eventId = cqe->user_data;
-        auto& event = mEvents[eventId];
-//        std::cout << "Event: " << event->id << ", type: " << event->name() << ", status: " << cqe->res << std::endl;
+        auto eventIterator = mEvents.find(eventId);
 
-        EventContext context { *this, stopSource, cqe->res };
-        if (!event->handle(context)) {
-            removeEvent(eventId);
+        // Completions can arrive for events that are already removed (e.g. multishot operations)
+        if (eventIterator != mEvents.end()) {
+            auto& event = eventIterator->second;
+//            std::cout << "Event: " << event->id << ", type: " << event->name() << ", status: " << cqe->res << std::endl;
+
+            mMetrics.completions++;
+            EventContext context { *this, stopSource, cqe->res, cqe->flags, mIterationArena };
+            if (!event->handle(context)) {
+                removeEvent(eventId);
+            }
         }
 
         io_uring_cqe_seen(&mRing, cqe);
-        executeDispatched();
+        finishIteration();
         return true;
     }
 
-    void EventLoop::dispatch(DispatchedCallback callback) {
-        std::scoped_lock guard(mDispatchMutex);
-        mDispatchQueue.push_back(std::move(callback));
+    const EventLoopMetrics& EventLoop::metrics() const {
+        return mMetrics;
     }
 
-    void EventLoop::executeDispatched() {
-        {
-            std::scoped_lock guard(mDispatchMutex);
-            std::swap(mDispatchQueue, mExecutingDispatched);
+    bool EventLoop::ringFdRegistered() const {
+        return mRingFdRegistered;
+    }
+
+    std::uint32_t EventLoop::ringDepth() const {
+        return mRing.sq.ring_entries;
+    }
+
+    std::uint32_t EventLoop::completionQueueSize() const {
+        return mRing.cq.ring_entries;
+    }
+
+    Expected<bool> EventLoop::resizeRing(std::uint32_t depth, std::uint32_t completionQueueSize) {
+        // Prepared operations must reach the kernel before the queues change
+        auto result = flushSubmissions();
+        if (!result) {
+            return result.error();
         }
 
-        for (auto& dispatch : mExecutingDispatched) {
-            dispatch(*this);
+#if defined(EVENT_LOOP_HAVE_RESIZE_RINGS)
+        auto params = ringParameters({ depth, completionQueueSize }, true);
+        if (io_uring_resize_rings(&mRing, &params) == 0) {
+            mMetrics.ringResizes++;
+            return true;
         }
-        mExecutingDispatched.clear();
-    }
+#endif
 
-    void EventLoop::close(AnyFd fd, CloseEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<CloseEvent>(fd, std::move(callback));
-        try {
-            close(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+        // Not supported by liburing, the kernel or the ring setup. Recreating the ring would lose the operations in flight,
+        // which persistent events (multishot receives, accepts, signals, file watches) never stop having.
+        if (!mEvents.empty()) {
+            return Error { "resize_ring", -EBUSY };
+        }
+
+        result = recreateRing({ depth, completionQueueSize });
+        if (!result) {
+            return result.error();
         }
+
+        return true;
     }
 
-    void EventLoop::close(CloseEvent& event, SubmitGuard* submit) {
-        auto sqe = getSqe();
+    io_uring_params EventLoop::ringParameters(RingSize size, bool resize) const {
+        io_uring_params params {};
+        if (!resize && mRingOptions.singleIssuer) {
+            params.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        }
 
-        io_uring_prep_close(sqe, event.fd.fd);
-        sqe->user_data = event.id;
+        params.sq_entries = size.depth;
+        if (size.completionQueueSize > 0) {
+            params.flags |= IORING_SETUP_CQSIZE;
+            params.cq_entries = size.completionQueueSize;
+        }
 
-        submitRing(submit);
+        return params;
     }
 
-    void EventLoop::timer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit) {
-        auto durationNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
-        auto& event = createEvent<TimerEvent>(durationNanoseconds, std::move(callback));
-        try {
-            timer(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+    Expected<> EventLoop::recreateRing(RingSize size) {
+        RingSize previous { ringDepth(), completionQueueSize() };
+        io_uring_queue_exit(&mRing);
+        mRing = {};
+
+        auto params = ringParameters(size, false);
+        auto result = checkResult(io_uring_queue_init_params(size.depth, &mRing, &params), "io_uring_queue_init_params");
+        if (!result) {
+            // The loop cannot be without a ring
+            mRing = {};
+            params = ringParameters(previous, false);
+            EventLoopException::throwIfFailed(io_uring_queue_init_params(previous.depth, &mRing, &params), "io_uring_queue_init_params");
+        }
+
+        mRingFdRegistered = io_uring_register_ring_fd(&mRing) == 1;
+        mLastCompletionOverflow = *mRing.cq.koverflow;
+        mDroppedCompletions = *mRing.cq.koverflow;
+
+        if (!result) {
+            return result.error();
         }
+
+        mMetrics.ringResizes++;
+        return {};
     }
 
-    void EventLoop::timer(TimerEvent& event, SubmitGuard* submit) {
-        auto sqe = getSqe();
+    void EventLoop::checkCompletionOverflow() {
+        auto overflowing = (std::atomic_ref(*mRing.sq.kflags).load(std::memory_order_relaxed) & IORING_SQ_CQ_OVERFLOW) != 0;
+        if (overflowing) {
+            mMetrics.completionOverflows++;
+            mCompletionBackpressure = true;
 
-        auto now = TimerEvent::Clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - event.startTime);
-        auto sleepTime = std::max(std::chrono::nanoseconds(0), event.duration - elapsed);
-        event.eventDelay = createKernelTimeSpec(sleepTime);
+            // Moves the completions the kernel holds in its backlog into the completion queue, as far as there is room
+            static_cast<void>(io_uring_get_events(&mRing));
+        }
+
+        auto dropped = std::atomic_ref(*mRing.cq.koverflow).load(std::memory_order_relaxed);
+        if (dropped != mDroppedCompletions) {
+            mMetrics.droppedCompletions += dropped - mDroppedCompletions;
+            mDroppedCompletions = dropped;
+            mCompletionBackpressure = true;
+        }
 
-        io_uring_prep_timeout(sqe, &event.eventDelay, 1, 0);
-        sqe->user_data = event.id;
+        // Resume once the backlog is gone and the completion queue is at most half full
+        if (mCompletionBackpressure && !overflowing && io_uring_cq_ready(&mRing) <= mRing.cq.ring_entries / 2) {
+            mCompletionBackpressure = false;
 
-        submitRing(submit);
+            std::pmr::vector<DeferredRearm> deferredRearms { mResource };
+            std::swap(deferredRearms, mDeferredRearms);
+            for (auto& deferred : deferredRearms) {
+                auto eventIterator = mEvents.find(deferred.id);
+                if (eventIterator != mEvents.end() && !deferred.rearm(*this, *eventIterator->second)) {
+                    removeEvent(deferred.id);
+                }
+            }
+        }
     }
 
-    TcpListener EventLoop::tcpListen(in_addr address, std::uint16_t port, int backlog) {
-        auto socketFd = EventLoopException::throwIfFailed(socket(PF_INET, SOCK_STREAM, 0), "socket");
+    bool EventLoop::rearm(Event& event, RearmFunction rearm) {
+        if (mCompletionBackpressure) {
+            mMetrics.deferredRearms++;
+            mDeferredRearms.push_back({ event.id, rearm });
+            return true;
+        }
 
-        int enable = 1;
-        EventLoopException::throwIfFailed(
-            setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)),
-            "setsockopt(SO_REUSEADDR)"
-        );
+        return rearm(*this, event).hasValue();
+    }
 
-        sockaddr_in socketAddress {};
-        socketAddress.sin_family = AF_INET;
-        socketAddress.sin_addr = address;
-        socketAddress.sin_port = htons(port);
-        socketAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    void EventLoop::trackRingOccupancy() {
+        mPeakSubmissionQueue = std::max(mPeakSubmissionQueue, io_uring_sq_ready(&mRing));
+    }
 
-        EventLoopException::throwIfFailed(
-            bind(socketFd, (const sockaddr*)&socketAddress, sizeof(socketAddress)),
-            "bind"
-        );
+    void EventLoop::checkRingSize() {
+        mIterationsSinceResizeCheck++;
+        if (mIterationsSinceResizeCheck < mRingOptions.resizeCheckIterations) {
+            return;
+        }
 
-        EventLoopException::throwIfFailed(listen(socketFd, backlog), "listen");
-        return TcpListener { Socket { socketFd }, socketAddress };
-    }
+        auto depth = ringDepth();
+        auto completionQueueEntries = completionQueueSize();
+        auto completionOverflow = *mRing.cq.koverflow;
+
+        auto grow = mSubmissionQueueFullSinceCheck > 0
+            || completionOverflow != mLastCompletionOverflow
+            || mPeakCompletionQueue >= completionQueueEntries / 4 * 3;
+        auto shrink = !grow
+            && mPeakSubmissionQueue < depth / 4
+            && mPeakCompletionQueue < completionQueueEntries / 4;
+
+        mIterationsSinceResizeCheck = 0;
+        mPeakSubmissionQueue = 0;
+        mPeakCompletionQueue = 0;
+        mSubmissionQueueFullSinceCheck = 0;
+        mLastCompletionOverflow = completionOverflow;
+
+        auto newDepth = depth;
+        if (grow) {
+            newDepth = std::min(depth * 2, mRingOptions.maxDepth);
+        } else if (shrink) {
+            newDepth = std::max(depth / 2, mRingOptions.minDepth);
+        }
 
-    Socket EventLoop::udpReceiver(in_addr address, std::uint16_t port) {
-        auto socketFd = EventLoopException::throwIfFailed(socket(PF_INET, SOCK_DGRAM, 0), "socket");
+        if (newDepth == depth) {
+            return;
+        }
 
-        sockaddr_in serverAddress {};
-        serverAddress.sin_family = AF_INET;
-        serverAddress.sin_addr = address;
-        serverAddress.sin_port = htons(port);
-        serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+        // Keep the configured ratio between the queues
+        std::uint32_t newCompletionQueueSize = 0;
+        if (mRingOptions.completionQueueSize > 0) {
+            newCompletionQueueSize = (std::uint32_t)((std::uint64_t)mRingOptions.completionQueueSize * newDepth / mRingOptions.depth);
+        }
 
-        EventLoopException::throwIfFailed(
-            bind(socketFd, (const sockaddr*)&serverAddress, sizeof(serverAddress)),
-            "bind"
-        );
+        // Retried at the next check if the ring could not be resized
+        static_cast<void>(resizeRing(newDepth, newCompletionQueueSize));
+    }
 
-        return Socket { socketFd };
+    MonotonicArena& EventLoop::iterationArena() {
+        return mIterationArena;
     }
 
-    UnixListener EventLoop::unixListen(const std::string& path, int backlog) {
-        auto socketFd = EventLoopException::throwIfFailed(socket(PF_UNIX, SOCK_STREAM, 0), "socket");
+    std::pmr::memory_resource* EventLoop::resource() const {
+        return mResource;
+    }
 
-        sockaddr_un socketAddress {};
-        socketAddress.sun_family = AF_UNIX;
-        strcpy(socketAddress.sun_path, path.c_str());
-        EventLoopException::throwIfFailed(unlink(path.c_str()), "unlink");
+    void EventLoop::dispatch(DispatchedCallback callback) {
+        std::scoped_lock guard(mDispatchMutex);
+        mDispatchQueue.push_back(std::move(callback));
+    }
 
-        EventLoopException::throwIfFailed(
-            bind(socketFd, (const sockaddr*)&socketAddress, sizeof(socketAddress)),
-            "bind"
+    void EventLoop::dispatch(std::span<DispatchedCallback> callbacks) {
+        std::scoped_lock guard(mDispatchMutex);
+        mDispatchQueue.insert(
+            mDispatchQueue.end(),
+            std::make_move_iterator(callbacks.begin()),
+            std::make_move_iterator(callbacks.end())
         );
+    }
 
-        EventLoopException::throwIfFailed(listen(socketFd, backlog), "listen");
-        return UnixListener { Socket { socketFd }, socketAddress };
+    void dispatchOn(EventLoop& eventLoop, std::function<void (EventLoop&)> callback) {
+        eventLoop.dispatch(std::move(callback));
     }
 
-    void EventLoop::accept(const TcpListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<AcceptEvent>(listener.socket(), SocketType::Inet, std::move(callback));
-        try {
-            accept(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+    void EventLoop::executeDispatched() {
+        {
+            std::scoped_lock guard(mDispatchMutex);
+            std::swap(mDispatchQueue, mExecutingDispatched);
         }
-    }
 
-    void EventLoop::accept(const UnixListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<AcceptEvent>(listener.socket(), SocketType::Unix, std::move(callback));
-        try {
-            accept(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+        mMetrics.dispatched += mExecutingDispatched.size();
+        for (auto& dispatch : mExecutingDispatched) {
+            dispatch(*this);
         }
+        mExecutingDispatched.clear();
     }
 
-    void EventLoop::accept(AcceptEvent& event, SubmitGuard* submit) {
-        auto sqe = getSqe();
-
-        std::visit(overloaded {
-            [&](const sockaddr_in& address) {
-                io_uring_prep_accept(sqe, event.server.fd, (sockaddr*)&address, &event.clientAddressLength, 0);
-            },
-            [&](const sockaddr_un& address) {
-                io_uring_prep_accept(sqe, event.server.fd, (sockaddr*)&address, &event.clientAddressLength, 0);
-            },
-        }, event.clientAddress);
-        sqe->user_data = event.id;
+    void EventLoop::nop(NopEvent::Callback callback, SubmitGuard* submit) {
+        tryNop(std::move(callback), submit).valueOrThrow();
+    }
 
-        submitRing(submit);
+    Expected<> EventLoop::tryNop(NopEvent::Callback callback, SubmitGuard* submit) {
+        auto& event = createEvent<NopEvent>(std::move(callback));
+        return removeIfFailed(event.id, nop(event, submit));
     }
 
-    void EventLoop::connect(in_addr_t address, std::uint16_t port, ConnectEvent::Callback callback, SubmitGuard* submit) {
-        Socket clientSocket { EventLoopException::throwIfFailed(socket(AF_INET, SOCK_STREAM, 0), "socket") };
+    Expected<> EventLoop::nop(NopEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
 
-        sockaddr_in serverAddress {};
-        serverAddress.sin_family = AF_INET;
-        serverAddress.sin_addr.s_addr = address;
-        serverAddress.sin_port = htons(port);
+        io_uring_prep_nop(*sqe);
+        (*sqe)->user_data = event.id;
 
-        auto& event = createEvent<ConnectEvent>(clientSocket, serverAddress, std::move(callback));
-        try {
-            connect(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
-        }
+        return submitRing(submit);
     }
 
-    void EventLoop::connect(const std::string& path, ConnectEvent::Callback callback, SubmitGuard* submit) {
-        Socket clientSocket { EventLoopException::throwIfFailed(socket(AF_UNIX, SOCK_STREAM, 0), "socket") };
+    void EventLoop::close(AnyFd fd, CloseEvent::Callback callback, SubmitGuard* submit) {
+        tryClose(fd, std::move(callback), submit).valueOrThrow();
+    }
 
-        sockaddr_un serverAddress {};
-        serverAddress.sun_family = AF_UNIX;
-        strcpy(serverAddress.sun_path, path.c_str());
+    Expected<> EventLoop::tryClose(AnyFd fd, CloseEvent::Callback callback, SubmitGuard* submit) {
+        auto& event = createEvent<CloseEvent>(fd, std::move(callback));
 
-        auto& event = createEvent<ConnectEvent>(clientSocket, serverAddress, std::move(callback));
-        try {
-            connect(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+        // Detached from the descriptor right away, as the descriptor can be reused as soon as it is closed
+        connectionClosed(fd.fd);
+        auto arenaIterator = mConnectionArenas.find(fd.fd);
+        if (arenaIterator != mConnectionArenas.end()) {
+            event.arena = std::move(arenaIterator->second);
+            mConnectionArenas.erase(arenaIterator);
         }
+
+        return removeIfFailed(event.id, close(event, submit));
     }
 
-    void EventLoop::connect(ConnectEvent& event, SubmitGuard* submit) {
+    Expected<> EventLoop::close(CloseEvent& event, SubmitGuard* submit) {
         auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
 
-        std::visit(overloaded {
-            [&](const sockaddr_in& serverAddress) {
-                io_uring_prep_connect(sqe, event.client.fd, (sockaddr*)&serverAddress, sizeof(serverAddress));
-            },
-            [&](const sockaddr_un& serverAddress) {
-                io_uring_prep_connect(sqe, event.client.fd, (sockaddr*)&serverAddress, sizeof(serverAddress));
-            },
-        }, event.serverAddress);
-        sqe->user_data = event.id;
+        io_uring_prep_close(*sqe, event.fd.fd);
+        (*sqe)->user_data = event.id;
 
-        submitRing(submit);
+        return submitRing(submit);
     }
 
-    void EventLoop::receive(Socket client, Buffer buffer, ReceiveEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<ReceiveEvent>(client, std::move(buffer), std::move(callback));
-        try {
-            receive(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
-        }
+    void EventLoop::timer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit) {
+        tryTimer(duration, std::move(callback), submit).valueOrThrow();
     }
 
-    void EventLoop::receive(ReceiveEvent& event, SubmitGuard* submit) {
-        auto sqe = getSqe();
-
-        io_uring_prep_recv(sqe, event.client.fd, event.buffer.data(), event.buffer.size(), 0);
-        sqe->user_data = event.id;
+    Expected<> EventLoop::tryTimer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit) {
+        return tryTimer(duration, std::chrono::duration<double>(0), std::move(callback), submit);
+    }
 
-        submitRing(submit);
+    void EventLoop::timer(std::chrono::duration<double> duration, std::chrono::duration<double> slack, TimerEvent::Callback callback, SubmitGuard* submit) {
+        tryTimer(duration, slack, std::move(callback), submit).valueOrThrow();
     }
 
-    void EventLoop::send(Socket client, Buffer data, SendEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<SendEvent>(client, std::move(data), std::move(callback));
-        try {
-            send(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
-        }
+    Expected<> EventLoop::tryTimer(std::chrono::duration<double> duration, std::chrono::duration<double> slack, TimerEvent::Callback callback, SubmitGuard* submit) {
+        auto durationNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
+        auto slackNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(slack);
+        auto& event = createEvent<TimerEvent>(durationNanoseconds, slackNanoseconds, std::move(callback));
+        return removeIfFailed(event.id, timer(event, submit));
     }
 
-    void EventLoop::send(SendEvent& event, SubmitGuard* submit) {
-        auto sqe = getSqe();
+    void EventLoop::backgroundTimer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit) {
+        tryBackgroundTimer(duration, std::move(callback), submit).valueOrThrow();
+    }
 
-        io_uring_prep_send(sqe, event.client.fd, event.data.data(), event.data.size(), 0);
-        sqe->user_data = event.id;
+    Expected<> EventLoop::tryBackgroundTimer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit) {
+        return tryTimer(duration, mDefaultTimerSlack, std::move(callback), submit);
+    }
 
-        submitRing(submit);
+    std::chrono::nanoseconds EventLoop::defaultTimerSlack() const {
+        return mDefaultTimerSlack;
     }
 
-    void EventLoop::openFile(std::filesystem::path path, OpenFileEvent::Callback callback, SubmitGuard* submit) {
-        openFile(std::move(path), 0, 0, std::move(callback));
+    void EventLoop::setDefaultTimerSlack(std::chrono::duration<double> slack) {
+        mDefaultTimerSlack = std::chrono::duration_cast<std::chrono::nanoseconds>(slack);
     }
 
-    void EventLoop::openFile(std::filesystem::path path, int flags, mode_t mode, OpenFileEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<OpenFileEvent>(std::move(path), flags, mode, std::move(callback));
-        try {
-            openFile(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+    Expected<> EventLoop::timer(TimerEvent& event, SubmitGuard* submit) {
+        if (event.slack.count() > 0) {
+            return slackTimer(event, submit);
         }
-    }
 
-    void EventLoop::openFile(OpenFileEvent& event, SubmitGuard* submit) {
         auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        auto now = TimerEvent::Clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - event.startTime);
+        auto sleepTime = std::max(std::chrono::nanoseconds(0), event.duration - elapsed);
+        event.eventDelay = createKernelTimeSpec(sleepTime);
 
-        io_uring_prep_openat(sqe, AT_FDCWD, event.path.c_str(), event.flags, event.mode);
-        sqe->user_data = event.id;
+        io_uring_prep_timeout(*sqe, &event.eventDelay, 1, 0);
+        (*sqe)->user_data = event.id;
 
-        submitRing(submit);
+        return submitRing(submit);
     }
 
-    void EventLoop::readFile(File file, Buffer buffer, std::uint64_t offset, ReadFileEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<ReadFileEvent>(file, std::move(buffer), offset, std::move(callback));
-        try {
-            readFile(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+    Expected<> EventLoop::slackTimer(TimerEvent& event, SubmitGuard* submit) {
+        // Ordered by the latest time the timer can fire, which is when the earliest timer forces a wakeup
+        auto deadline = event.deadline();
+        mSlackTimers.emplace(deadline + event.slack, SlackTimer { deadline, event.id });
+        mMaxTimerSlack = std::max(mMaxTimerSlack, event.slack);
+
+        auto result = armTimerWakeup(submit);
+        if (!result) {
+            auto [begin, end] = mSlackTimers.equal_range(deadline + event.slack);
+            for (auto iterator = begin; iterator != end; ++iterator) {
+                if (iterator->second.id == event.id) {
+                    mSlackTimers.erase(iterator);
+                    break;
+                }
+            }
         }
+
+        return result;
     }
 
-    void EventLoop::readFile(ReadFileEvent& event, SubmitGuard* submit) {
-        auto sqe = getSqe();
+    Expected<> EventLoop::armTimerWakeup(SubmitGuard* submit) {
+        if (mSlackTimers.empty()) {
+            return {};
+        }
 
-        io_uring_prep_read(sqe, event.file.fd, event.buffer.data(), event.buffer.size(), event.offset);
-        sqe->user_data = event.id;
+        auto wakeupTime = mSlackTimers.begin()->first;
+        auto pendingIterator = mEvents.find(mTimerWakeupId);
+        if (pendingIterator != mEvents.end()) {
+            auto& pending = static_cast<TimerWakeupEvent&>(*pendingIterator->second);
 
-        submitRing(submit);
-    }
+            // An earlier (or equal) wakeup is already pending
+            if (pending.wakeupTime <= wakeupTime) {
+                return {};
+            }
 
-    void EventLoop::writeFile(File file, Buffer data, WriteFileEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<WriteFileEvent>(file, std::move(data), std::move(callback));
-        try {
-            writeFile(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+            // Move the pending wakeup earlier rather than leaving a superseded timeout behind.
+            // If it has already fired, the update fails and the completion re-arms instead.
+            auto sqe = getSqe();
+            if (!sqe) {
+                return sqe.error();
+            }
+
+            auto sleepTime = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeupTime - TimerEvent::Clock::now());
+            pending.wakeupTime = wakeupTime;
+            pending.eventDelay = createKernelTimeSpec(sleepTime);
+
+            io_uring_prep_timeout_update(*sqe, &pending.eventDelay, pending.id, 0);
+            (*sqe)->user_data = IgnoredEventId;
+            return submitRing(submit);
         }
-    }
 
-    void EventLoop::writeFile(WriteFileEvent& event, SubmitGuard* submit) {
+        auto& event = createEvent<TimerWakeupEvent>(wakeupTime);
+
         auto sqe = getSqe();
+        if (!sqe) {
+            removeEvent(event.id);
+            return sqe.error();
+        }
 
-        io_uring_prep_write(sqe, event.file.fd, event.data.data(), event.data.size(), 0);
-        sqe->user_data = event.id;
+        auto sleepTime = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeupTime - TimerEvent::Clock::now());
+        event.eventDelay = createKernelTimeSpec(sleepTime);
 
-        submitRing(submit);
-    }
+        io_uring_prep_timeout(*sqe, &event.eventDelay, 1, 0);
+        (*sqe)->user_data = event.id;
 
-    void EventLoop::readFileStats(std::filesystem::path path, ReadFileStatsEvent::Callback callback, SubmitGuard* submit) {
-        auto& event = createEvent<ReadFileStatsEvent>(std::move(path), std::move(callback));
-        try {
-            readFileStats(event, submit);
-        } catch (const EventLoopException& e) {
-            removeEvent(event.id);
-            throw;
+        auto result = removeIfFailed(event.id, submitRing(submit));
+        if (result) {
+            mTimerWakeupId = event.id;
         }
+
+        return result;
     }
 
-    void EventLoop::readFileStats(ReadFileStatsEvent& event, SubmitGuard* submit) {
-        auto sqe = getSqe();
+    void EventLoop::expireSlackTimers(EventContext& context, EventId wakeupId) {
+        mMetrics.timerWakeups++;
+
+        if (mTimerWakeupId == wakeupId) {
+            mTimerWakeupId = IgnoredEventId;
+        }
+
+        // Collect the expired timers first, as periodic timers are added again when handled.
+        // Any timer with a deadline that has passed must have a latest time within the max slack from now.
+        auto now = TimerEvent::Clock::now();
+        std::pmr::vector<EventId> expired { &mIterationArena };
+        for (auto iterator = mSlackTimers.begin(); iterator != mSlackTimers.end() && iterator->first <= now + mMaxTimerSlack;) {
+            if (iterator->second.deadline <= now) {
+                expired.push_back(iterator->second.id);
+                iterator = mSlackTimers.erase(iterator);
+            } else {
+                ++iterator;
+            }
+        }
+
+        for (auto id : expired) {
+            auto eventIterator = mEvents.find(id);
+            if (eventIterator == mEvents.end()) {
+                continue;
+            }
 
-        io_uring_prep_statx(sqe, AT_FDCWD, event.path.c_str(), event.flags, event.mask, &event.stats);
-        sqe->user_data = event.id;
+            mMetrics.coalescedTimers++;
+            EventContext timerContext { *this, context.stopSource, -ETIME, 0, context.arena };
+            if (!eventIterator->second->handle(timerContext)) {
+                removeEvent(id);
+            }
+        }
 
-        submitRing(submit);
+        static_cast<void>(armTimerWakeup(nullptr));
     }
 
-    void EventLoop::readLine(Buffer buffer, ReadLineEvent::Callback callback, SubmitGuard* submit) {
-        readFile(
-            File::stdinFile(),
+    TcpListener EventLoop::tcpListen(in_addr address, std::uint16_t port, int backlog) {
+        return tryTcpListen(address, port, backlog).valueOrThrow();
+    }
+
+    Expected<TcpListener> EventLoop::tryTcpListen(in_addr address, std::uint16_t port, int backlog) {
+        return tryTcpListen(address, port, TcpListenOptions { .backlog = backlog });
+    }
+
+    TcpListener EventLoop::tcpListen(in_addr address, std::uint16_t port, TcpListenOptions options) {
+        return tryTcpListen(address, port, options).valueOrThrow();
+    }
+
+    Expected<TcpListener> EventLoop::tryTcpListen(in_addr address, std::uint16_t port, TcpListenOptions options) {
+        auto socketFd = checkSystemCall(socket(PF_INET, SOCK_STREAM, 0), "socket");
+        if (!socketFd) {
+            return socketFd.error();
+        }
+
+        int enable = 1;
+        auto result = checkSystemCall(setsockopt(*socketFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)), "setsockopt(SO_REUSEADDR)");
+        if (!result) {
+            ::close(*socketFd);
+            return result.error();
+        }
+
+        if (auto reuseResult = configureReusePort(*socketFd, options.reusePort); !reuseResult) {
+            ::close(*socketFd);
+            return reuseResult.error();
+        }
+
+        sockaddr_in socketAddress {};
+        socketAddress.sin_family = AF_INET;
+        socketAddress.sin_addr = address;
+        socketAddress.sin_port = htons(port);
+        socketAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        result = checkSystemCall(bind(*socketFd, (const sockaddr*)&socketAddress, sizeof(socketAddress)), "bind");
+        if (!result) {
+            ::close(*socketFd);
+            return result.error();
+        }
+
+        result = checkSystemCall(listen(*socketFd, options.backlog), "listen");
+        if (!result) {
+            ::close(*socketFd);
+            return result.error();
+        }
+
+        return TcpListener { Socket { *socketFd }, socketAddress };
+    }
+
+    Socket EventLoop::udpReceiver(in_addr address, std::uint16_t port) {
+        return tryUdpReceiver(address, port).valueOrThrow();
+    }
+
+    Expected<Socket> EventLoop::tryUdpReceiver(in_addr address, std::uint16_t port) {
+        return tryUdpReceiver(address, port, UdpReceiverOptions {});
+    }
+
+    Socket EventLoop::udpReceiver(in_addr address, std::uint16_t port, UdpReceiverOptions options) {
+        return tryUdpReceiver(address, port, options).valueOrThrow();
+    }
+
+    Expected<Socket> EventLoop::tryUdpReceiver(in_addr address, std::uint16_t port, UdpReceiverOptions options) {
+        auto socketFd = checkSystemCall(socket(PF_INET, SOCK_DGRAM, 0), "socket");
+        if (!socketFd) {
+            return socketFd.error();
+        }
+
+        int enable = 1;
+        if (options.receiveTimestamps) {
+            auto result = checkSystemCall(setsockopt(*socketFd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(int)), "setsockopt(SO_TIMESTAMPNS)");
+            if (!result) {
+                ::close(*socketFd);
+                return result.error();
+            }
+        }
+
+        if (options.genericReceiveOffload) {
+            auto result = checkSystemCall(setsockopt(*socketFd, SOL_UDP, UDP_GRO, &enable, sizeof(int)), "setsockopt(UDP_GRO)");
+            if (!result) {
+                ::close(*socketFd);
+                return result.error();
+            }
+        }
+
+        if (auto result = configureReusePort(*socketFd, options.reusePort); !result) {
+            ::close(*socketFd);
+            return result.error();
+        }
+
+        sockaddr_in serverAddress {};
+        serverAddress.sin_family = AF_INET;
+        serverAddress.sin_addr = address;
+        serverAddress.sin_port = htons(port);
+        serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        auto result = checkSystemCall(bind(*socketFd, (const sockaddr*)&serverAddress, sizeof(serverAddress)), "bind");
+        if (!result) {
+            ::close(*socketFd);
+            return result.error();
+        }
+
+        return Socket { *socketFd };
+    }
+
+    UnixListener EventLoop::unixListen(const std::string& path, int backlog) {
+        return tryUnixListen(path, backlog).valueOrThrow();
+    }
+
+    Expected<UnixListener> EventLoop::tryUnixListen(const std::string& path, int backlog) {
+        auto socketFd = checkSystemCall(socket(PF_UNIX, SOCK_STREAM, 0), "socket");
+        if (!socketFd) {
+            return socketFd.error();
+        }
+
+        sockaddr_un socketAddress {};
+        socketAddress.sun_family = AF_UNIX;
+        strcpy(socketAddress.sun_path, path.c_str());
+
+        auto result = checkSystemCall(unlink(path.c_str()), "unlink");
+        if (!result && result.error().errorCode() != ENOENT) {
+            ::close(*socketFd);
+            return result.error();
+        }
+
+        result = checkSystemCall(bind(*socketFd, (const sockaddr*)&socketAddress, sizeof(socketAddress)), "bind");
+        if (!result) {
+            ::close(*socketFd);
+            return result.error();
+        }
+
+        result = checkSystemCall(listen(*socketFd, backlog), "listen");
+        if (!result) {
+            ::close(*socketFd);
+            return result.error();
+        }
+
+        return UnixListener { Socket { *socketFd }, socketAddress };
+    }
+
+    void EventLoop::accept(const TcpListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit) {
+        tryAccept(listener, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryAccept(const TcpListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit) {
+        return tryAccept(listener, AdmissionOptions {}, std::move(callback), submit);
+    }
+
+    void EventLoop::accept(const UnixListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit) {
+        tryAccept(listener, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryAccept(const UnixListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit) {
+        return tryAccept(listener, AdmissionOptions {}, std::move(callback), submit);
+    }
+
+    void EventLoop::accept(const TcpListener& listener, AdmissionOptions admission, AcceptEvent::Callback callback, SubmitGuard* submit) {
+        tryAccept(listener, admission, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryAccept(const TcpListener& listener, AdmissionOptions admission, AcceptEvent::Callback callback, SubmitGuard* submit) {
+        mTrackLoopLatency |= admission.maxLoopLatency.has_value();
+        auto& event = createEvent<AcceptEvent>(listener.socket(), SocketType::Inet, admission, std::move(callback));
+        return removeIfFailed(event.id, accept(event, submit));
+    }
+
+    void EventLoop::accept(const UnixListener& listener, AdmissionOptions admission, AcceptEvent::Callback callback, SubmitGuard* submit) {
+        tryAccept(listener, admission, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryAccept(const UnixListener& listener, AdmissionOptions admission, AcceptEvent::Callback callback, SubmitGuard* submit) {
+        mTrackLoopLatency |= admission.maxLoopLatency.has_value();
+        auto& event = createEvent<AcceptEvent>(listener.socket(), SocketType::Unix, admission, std::move(callback));
+        return removeIfFailed(event.id, accept(event, submit));
+    }
+
+    Expected<> EventLoop::accept(AcceptEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        std::visit(overloaded {
+            [&](const sockaddr_in& address) {
+                io_uring_prep_accept(*sqe, event.server.fd, (sockaddr*)&address, &event.clientAddressLength, 0);
+            },
+            [&](const sockaddr_un& address) {
+                io_uring_prep_accept(*sqe, event.server.fd, (sockaddr*)&address, &event.clientAddressLength, 0);
+            },
+        }, event.clientAddress);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    bool EventLoop::admitConnection(AcceptEvent& event, Socket client) {
+        // A reused descriptor, where the connection it was admitted for was closed without close
+        if (mAdmittedConnections.contains(client.fd)) {
+            connectionClosed(client.fd);
+        }
+
+        auto& admission = event.admission;
+        auto overLimit = admission.maxConnections > 0 && event.connections >= admission.maxConnections;
+        if (admission.reject && (overLimit || shouldPauseAccept(event))) {
+            mMetrics.rejectedConnections++;
+            static_cast<void>(tryClose(client, {}));
+            return false;
+        }
+
+        if (admission.maxConnections > 0) {
+            event.connections++;
+            mAdmittedConnections[client.fd] = event.id;
+        }
+
+        return true;
+    }
+
+    bool EventLoop::shouldPauseAccept(const AcceptEvent& event) const {
+        auto& admission = event.admission;
+        if (admission.maxConnections > 0 && event.connections >= admission.maxConnections) {
+            return true;
+        }
+
+        if (admission.maxLoopLatency && mLoopLatency > *admission.maxLoopLatency) {
+            return true;
+        }
+
+        if (admission.maxBufferMemory && mBufferManager.stats().allocatedBytes > *admission.maxBufferMemory) {
+            return true;
+        }
+
+        return false;
+    }
+
+    Expected<> EventLoop::rearmAccept(AcceptEvent& event) {
+        // When rejecting, connections above the limits are closed instead
+        if (!event.admission.enabled() || event.admission.reject || !shouldPauseAccept(event)) {
+            return accept(event, nullptr);
+        }
+
+        event.paused = true;
+        mMetrics.acceptPauses++;
+        if (event.resumeCheckArmed) {
+            return {};
+        }
+
+        auto result = tryTimer(event.admission.resumeCheckInterval, [id = event.id](EventContext& context, const TimerEvent::Response& response) {
+            return context.eventLoop.checkPausedAccept(id);
+        });
+
+        event.resumeCheckArmed = result.hasValue();
+        return result;
+    }
+
+    bool EventLoop::checkPausedAccept(EventId id) {
+        auto eventIterator = mEvents.find(id);
+        if (eventIterator == mEvents.end()) {
+            return false;
+        }
+
+        auto& event = static_cast<AcceptEvent&>(*eventIterator->second);
+        if (event.paused && shouldPauseAccept(event)) {
+            return true;
+        }
+
+        event.resumeCheckArmed = false;
+        if (event.paused) {
+            event.paused = false;
+            if (!accept(event, nullptr)) {
+                removeEvent(id);
+            }
+        }
+
+        return false;
+    }
+
+    void EventLoop::connectionClosed(Fd fd) {
+        auto connectionIterator = mAdmittedConnections.find(fd);
+        if (connectionIterator == mAdmittedConnections.end()) {
+            return;
+        }
+
+        auto id = connectionIterator->second;
+        mAdmittedConnections.erase(connectionIterator);
+
+        auto eventIterator = mEvents.find(id);
+        if (eventIterator == mEvents.end()) {
+            return;
+        }
+
+        auto& event = static_cast<AcceptEvent&>(*eventIterator->second);
+        event.connections--;
+
+        if (event.paused && !shouldPauseAccept(event)) {
+            event.paused = false;
+            if (!accept(event, nullptr)) {
+                removeEvent(id);
+            }
+        }
+    }
+
+    void EventLoop::connect(in_addr_t address, std::uint16_t port, ConnectEvent::Callback callback, SubmitGuard* submit) {
+        tryConnect(address, port, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryConnect(in_addr_t address, std::uint16_t port, ConnectEvent::Callback callback, SubmitGuard* submit) {
+        auto socketFd = checkSystemCall(socket(AF_INET, SOCK_STREAM, 0), "socket");
+        if (!socketFd) {
+            return socketFd.error();
+        }
+
+        sockaddr_in serverAddress {};
+        serverAddress.sin_family = AF_INET;
+        serverAddress.sin_addr.s_addr = address;
+        serverAddress.sin_port = htons(port);
+
+        auto& event = createEvent<ConnectEvent>(Socket { *socketFd }, serverAddress, std::move(callback));
+        auto result = removeIfFailed(event.id, connect(event, submit));
+        if (!result) {
+            ::close(*socketFd);
+        }
+
+        return result;
+    }
+
+    void EventLoop::connect(const std::string& path, ConnectEvent::Callback callback, SubmitGuard* submit) {
+        tryConnect(path, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryConnect(const std::string& path, ConnectEvent::Callback callback, SubmitGuard* submit) {
+        auto socketFd = checkSystemCall(socket(AF_UNIX, SOCK_STREAM, 0), "socket");
+        if (!socketFd) {
+            return socketFd.error();
+        }
+
+        sockaddr_un serverAddress {};
+        serverAddress.sun_family = AF_UNIX;
+        strcpy(serverAddress.sun_path, path.c_str());
+
+        auto& event = createEvent<ConnectEvent>(Socket { *socketFd }, serverAddress, std::move(callback));
+        auto result = removeIfFailed(event.id, connect(event, submit));
+        if (!result) {
+            ::close(*socketFd);
+        }
+
+        return result;
+    }
+
+    Expected<> EventLoop::connect(ConnectEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        std::visit(overloaded {
+            [&](const sockaddr_in& serverAddress) {
+                io_uring_prep_connect(*sqe, event.client.fd, (sockaddr*)&serverAddress, sizeof(serverAddress));
+            },
+            [&](const sockaddr_un& serverAddress) {
+                io_uring_prep_connect(*sqe, event.client.fd, (sockaddr*)&serverAddress, sizeof(serverAddress));
+            },
+        }, event.serverAddress);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::receive(Socket client, Buffer buffer, ReceiveEvent::Callback callback, SubmitGuard* submit) {
+        tryReceive(client, std::move(buffer), std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryReceive(Socket client, Buffer buffer, ReceiveEvent::Callback callback, SubmitGuard* submit) {
+        auto& event = createEvent<ReceiveEvent>(client, std::move(buffer), std::move(callback));
+        return removeIfFailed(event.id, receive(event, submit));
+    }
+
+    Expected<> EventLoop::receive(ReceiveEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_recv(*sqe, event.client.fd, event.buffer.data(), event.buffer.size(), 0);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::receiveStream(Socket client, std::size_t capacity, ReceiveStreamEvent::Callback callback, SubmitGuard* submit) {
+        tryReceiveStream(client, capacity, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryReceiveStream(Socket client, std::size_t capacity, ReceiveStreamEvent::Callback callback, SubmitGuard* submit) {
+        auto ring = MirroredRingBuffer::create(capacity);
+        if (!ring) {
+            return ring.error();
+        }
+
+        auto& event = createEvent<ReceiveStreamEvent>(client, std::move(*ring), std::move(callback));
+        return removeIfFailed(event.id, receiveStream(event, submit));
+    }
+
+    Expected<> EventLoop::receiveStream(ReceiveStreamEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        auto writable = event.ring->writable();
+        io_uring_prep_recv(*sqe, event.client.fd, writable.data(), writable.size(), 0);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::receiveDatagrams(Socket socket, ReceiveDatagramsOptions options, ReceiveDatagramsEvent::Callback callback, SubmitGuard* submit) {
+        tryReceiveDatagrams(socket, options, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryReceiveDatagrams(Socket socket, ReceiveDatagramsOptions options, ReceiveDatagramsEvent::Callback callback, SubmitGuard* submit) {
+        auto bufferRing = ProvidedBufferRing::create(mRing, mBufferGroupIds, options.bufferCount, options.bufferSize, mResource);
+        if (!bufferRing) {
+            return bufferRing.error();
+        }
+
+        auto& event = createEvent<ReceiveDatagramsEvent>(socket, std::move(*bufferRing), std::move(callback));
+        return removeIfFailed(event.id, receiveDatagrams(event, submit));
+    }
+
+    Expected<> EventLoop::receiveDatagrams(ReceiveDatagramsEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_recvmsg_multishot(*sqe, event.socket.fd, &event.header, 0);
+        (*sqe)->flags |= IOSQE_BUFFER_SELECT;
+        (*sqe)->buf_group = event.bufferRing->groupId();
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::send(Socket client, Buffer data, SendEvent::Callback callback, SubmitGuard* submit) {
+        trySend(client, std::move(data), std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::trySend(Socket client, Buffer data, SendEvent::Callback callback, SubmitGuard* submit) {
+        auto& event = createEvent<SendEvent>(client, std::move(data), std::move(callback));
+        return removeIfFailed(event.id, send(event, submit));
+    }
+
+    Expected<> EventLoop::send(SendEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_send(*sqe, event.client.fd, event.data.data(), event.data.size(), 0);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::sendTo(Socket socket, SocketAddress destination, Buffer data, SendToEvent::Callback callback, SubmitGuard* submit) {
+        trySendTo(socket, destination, std::move(data), std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::trySendTo(Socket socket, SocketAddress destination, Buffer data, SendToEvent::Callback callback, SubmitGuard* submit) {
+        std::pmr::vector<Buffer> datagrams { mResource };
+        datagrams.push_back(std::move(data));
+
+        auto& event = createEvent<SendToEvent>(socket, destination, std::move(datagrams), std::move(callback));
+        return removeIfFailed(event.id, sendTo(event, submit));
+    }
+
+    void EventLoop::sendToBatch(Socket socket, SocketAddress destination, std::span<const Buffer> datagrams, SendToEvent::Callback callback, SubmitGuard* submit) {
+        trySendToBatch(socket, destination, datagrams, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::trySendToBatch(Socket socket, SocketAddress destination, std::span<const Buffer> datagrams, SendToEvent::Callback callback, SubmitGuard* submit) {
+        if (submit != nullptr) {
+            return sendSegmented(socket, destination, datagrams, callback, *submit);
+        }
+
+        SubmitGuard submitGuard(*this);
+        return sendSegmented(socket, destination, datagrams, callback, submitGuard);
+    }
+
+    void EventLoop::sendToMany(Socket socket, std::span<const Datagram> datagrams, SendToEvent::Callback callback, SubmitGuard* submit) {
+        trySendToMany(socket, datagrams, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::trySendToMany(Socket socket, std::span<const Datagram> datagrams, SendToEvent::Callback callback, SubmitGuard* submit) {
+        std::optional<SubmitGuard> submitGuard;
+        if (submit == nullptr) {
+            submit = &submitGuard.emplace(*this);
+        }
+
+        std::pmr::vector<Buffer> sameDestination { &mIterationArena };
+        std::size_t start = 0;
+        while (start < datagrams.size()) {
+            auto& destination = datagrams[start].destination;
+
+            sameDestination.clear();
+            auto end = start;
+            for (; end < datagrams.size() && sameAddress(datagrams[end].destination, destination); end++) {
+                sameDestination.push_back(datagrams[end].data);
+            }
+
+            auto result = sendSegmented(socket, destination, sameDestination, callback, *submit);
+            if (!result) {
+                return result;
+            }
+
+            start = end;
+        }
+
+        return {};
+    }
+
+    Expected<> EventLoop::sendSegmented(
+        Socket socket,
+        const SocketAddress& destination,
+        std::span<const Buffer> datagrams,
+        const SendToEvent::Callback& callback,
+        SubmitGuard& submit
+    ) {
+        std::size_t start = 0;
+        while (start < datagrams.size()) {
+            // All segments must be of the same size, except the last which may be smaller. Empty datagrams are sent on
+            // their own, as a segment size of zero would merge them into one.
+            auto segmentSize = datagrams[start].size();
+            auto end = start + 1;
+            auto totalSize = segmentSize;
+            while (segmentSize > 0
+                   && end < datagrams.size()
+                   && end - start < maxSegments
+                   && datagrams[end - 1].size() == segmentSize
+                   && datagrams[end].size() <= segmentSize
+                   && totalSize + datagrams[end].size() <= maxSegmentedSize) {
+                totalSize += datagrams[end].size();
+                end++;
+            }
+
+            std::pmr::vector<Buffer> segments { datagrams.begin() + (std::int64_t)start, datagrams.begin() + (std::int64_t)end, mResource };
+            auto& event = createEvent<SendToEvent>(socket, destination, std::move(segments), callback);
+            auto result = removeIfFailed(event.id, sendTo(event, &submit));
+            if (!result) {
+                return result;
+            }
+
+            start = end;
+        }
+
+        return {};
+    }
+
+    Expected<> EventLoop::sendTo(SendToEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_sendmsg(*sqe, event.socket.fd, &event.header, 0);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::openFile(std::filesystem::path path, OpenFileEvent::Callback callback, SubmitGuard* submit) {
+        tryOpenFile(std::move(path), std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryOpenFile(std::filesystem::path path, OpenFileEvent::Callback callback, SubmitGuard* submit) {
+        return tryOpenFile(std::move(path), 0, 0, std::move(callback), submit);
+    }
+
+    void EventLoop::openFile(std::filesystem::path path, int flags, mode_t mode, OpenFileEvent::Callback callback, SubmitGuard* submit) {
+        tryOpenFile(std::move(path), flags, mode, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryOpenFile(std::filesystem::path path, int flags, mode_t mode, OpenFileEvent::Callback callback, SubmitGuard* submit) {
+        auto& event = createEvent<OpenFileEvent>(std::move(path), flags, mode, std::move(callback));
+        return removeIfFailed(event.id, openFile(event, submit));
+    }
+
+    Expected<> EventLoop::openFile(OpenFileEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_openat(*sqe, AT_FDCWD, event.path.c_str(), event.flags, event.mode);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::readFile(File file, Buffer buffer, std::uint64_t offset, ReadFileEvent::Callback callback, SubmitGuard* submit) {
+        tryReadFile(file, std::move(buffer), offset, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryReadFile(File file, Buffer buffer, std::uint64_t offset, ReadFileEvent::Callback callback, SubmitGuard* submit) {
+        auto& event = createEvent<ReadFileEvent>(file, std::move(buffer), offset, std::move(callback));
+        return removeIfFailed(event.id, readFile(event, submit));
+    }
+
+    Expected<> EventLoop::readFile(ReadFileEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_read(*sqe, event.file.fd, event.buffer.data(), event.buffer.size(), event.offset);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::writeFile(File file, Buffer data, WriteFileEvent::Callback callback, SubmitGuard* submit) {
+        tryWriteFile(file, std::move(data), std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryWriteFile(File file, Buffer data, WriteFileEvent::Callback callback, SubmitGuard* submit) {
+        auto& event = createEvent<WriteFileEvent>(file, std::move(data), std::move(callback));
+        return removeIfFailed(event.id, writeFile(event, submit));
+    }
+
+    Expected<> EventLoop::writeFile(WriteFileEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_write(*sqe, event.file.fd, event.data.data(), event.data.size(), 0);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::readFileStats(std::filesystem::path path, ReadFileStatsEvent::Callback callback, SubmitGuard* submit) {
+        tryReadFileStats(std::move(path), std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryReadFileStats(std::filesystem::path path, ReadFileStatsEvent::Callback callback, SubmitGuard* submit) {
+        if (mFileStatsCacheOptions.enabled) {
+            return readCachedFileStats(std::move(path), std::move(callback), submit);
+        }
+
+        auto& event = createEvent<ReadFileStatsEvent>(std::move(path), std::move(callback));
+        return removeIfFailed(event.id, readFileStats(event, submit));
+    }
+
+    Expected<> EventLoop::readFileStats(ReadFileStatsEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_statx(*sqe, AT_FDCWD, event.path.c_str(), event.flags, event.mask, &event.stats);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    Expected<> EventLoop::readCachedFileStats(std::filesystem::path path, ReadFileStatsEvent::Callback callback, SubmitGuard* submit) {
+        std::string_view key = path.native();
+        auto cached = mFileStatsCache.find(key);
+        if (cached != mFileStatsCache.end()) {
+            if (cached->second.expires > std::chrono::steady_clock::now()) {
+                mMetrics.fileStatsCacheHits++;
+
+                // Copied, as the callback can change the cache
+                auto entry = cached->second;
+                if (callback) {
+                    EventContext context { *this, mStopSource, entry.result, 0, mIterationArena };
+                    callback(context, { entry.stats });
+                }
+
+                return {};
+            }
+
+            mFileStatsCache.erase(cached);
+        }
+
+        mMetrics.fileStatsCacheMisses++;
+
+        // Watched before reading, so that no change after the read is missed. Not cached if the directory cannot be watched.
+        if (!watchStatsDirectory(path.parent_path().native())) {
+            auto& event = createEvent<ReadFileStatsEvent>(std::move(path), std::move(callback));
+            return removeIfFailed(event.id, readFileStats(event, submit));
+        }
+
+        auto& event = createEvent<ReadFileStatsEvent>(
+            std::move(path),
+            [key = std::pmr::string { key, mResource }, generation = mFileStatsGeneration, callback = std::move(callback)](EventContext& context, const ReadFileStatsEvent::Response& response) {
+                context.eventLoop.cacheFileStats(key, generation, context.result, response.stats);
+                if (callback) {
+                    callback(context, response);
+                }
+            }
+        );
+
+        return removeIfFailed(event.id, readFileStats(event, submit));
+    }
+
+    void EventLoop::cacheFileStats(std::string_view key, std::uint64_t generation, Result result, const std::optional<struct statx>& stats) {
+        if (!mFileStatsCacheOptions.enabled || mFileStatsClearedGeneration > generation) {
+            return;
+        }
+
+        // Changed while being read
+        auto directoryGeneration = mStatsDirectoryGenerations.find(std::filesystem::path(key).parent_path().native());
+        if (directoryGeneration != mStatsDirectoryGenerations.end() && directoryGeneration->second > generation) {
+            return;
+        }
+
+        auto missing = result == -ENOENT || result == -ENOTDIR;
+        if (result < 0 && !missing) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (mFileStatsCache.size() >= mFileStatsCacheOptions.maxEntries) {
+            std::erase_if(mFileStatsCache, [&](const auto& entry) { return entry.second.expires <= now; });
+            if (mFileStatsCache.size() >= mFileStatsCacheOptions.maxEntries) {
+                return;
+            }
+        }
+
+        auto timeToLive = missing ? mFileStatsCacheOptions.negativeTimeToLive : mFileStatsCacheOptions.timeToLive;
+        mFileStatsCache.insert_or_assign(std::pmr::string { key, mResource }, CachedFileStats { stats, result, now + timeToLive });
+    }
+
+    bool EventLoop::watchStatsDirectory(std::string_view directory) {
+        if (mStatsWatchedDirectories.contains(directory)) {
+            return true;
+        }
+
+        auto result = tryWatch(
+            directory.empty() ? std::string_view { "." } : directory,
+            IN_ATTRIB | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF,
+            [directory = std::string { directory }](EventContext& context, const WatchEvent::Response& response) {
+                auto& eventLoop = context.eventLoop;
+                if (response.name.empty() || (response.mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) != 0) {
+                    eventLoop.invalidateStatsDirectory(directory);
+                } else {
+                    // The directory itself changes (modification time) along with its entries
+                    eventLoop.invalidateFileStats(directory.empty() ? std::filesystem::path(response.name) : std::filesystem::path(directory) / response.name);
+                    eventLoop.invalidateFileStats(directory);
+                }
+
+                if ((response.mask & IN_IGNORED) != 0) {
+                    auto watched = eventLoop.mStatsWatchedDirectories.find(directory);
+                    if (watched != eventLoop.mStatsWatchedDirectories.end()) {
+                        eventLoop.mStatsWatchedDirectories.erase(watched);
+                    }
+
+                    return false;
+                }
+
+                return true;
+            }
+        );
+
+        if (!result) {
+            return false;
+        }
+
+        mStatsWatchedDirectories.emplace(directory);
+        return true;
+    }
+
+    const FileStatsCacheOptions& EventLoop::fileStatsCache() const {
+        return mFileStatsCacheOptions;
+    }
+
+    void EventLoop::setFileStatsCache(FileStatsCacheOptions options) {
+        mFileStatsCacheOptions = options;
+        if (!mFileStatsCacheOptions.enabled) {
+            clearFileStats();
+        }
+    }
+
+    void EventLoop::invalidateFileStats(const std::filesystem::path& path) {
+        invalidateStatsGeneration(path.parent_path().native());
+
+        auto cached = mFileStatsCache.find(path.native());
+        if (cached != mFileStatsCache.end()) {
+            mFileStatsCache.erase(cached);
+        }
+    }
+
+    void EventLoop::invalidateStatsDirectory(std::string_view directory) {
+        // Covers the entries of the directory as well as the directory itself
+        invalidateStatsGeneration(directory);
+        invalidateStatsGeneration(std::filesystem::path(directory).parent_path().string());
+        std::erase_if(mFileStatsCache, [&](const auto& entry) {
+            return entry.first == directory || std::filesystem::path(entry.first).parent_path() == directory;
+        });
+    }
+
+    void EventLoop::invalidateStatsGeneration(std::string_view directory) {
+        auto generation = ++mFileStatsGeneration;
+        auto directoryGeneration = mStatsDirectoryGenerations.find(directory);
+        if (directoryGeneration != mStatsDirectoryGenerations.end()) {
+            directoryGeneration->second = generation;
+        } else {
+            mStatsDirectoryGenerations.emplace(directory, generation);
+        }
+    }
+
+    void EventLoop::clearFileStats() {
+        // Supersedes the generations of all directories
+        mFileStatsClearedGeneration = ++mFileStatsGeneration;
+        mStatsDirectoryGenerations.clear();
+        mFileStatsCache.clear();
+    }
+
+    void EventLoop::readLine(Buffer buffer, ReadLineEvent::Callback callback, SubmitGuard* submit) {
+        tryReadLine(std::move(buffer), std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryReadLine(Buffer buffer, ReadLineEvent::Callback callback, SubmitGuard* submit) {
+        return tryReadFile(
+            File::stdinFile(),
             std::move(buffer),
             0,
             [line = std::string(), callback = std::move(callback)](EventContext& context, const ReadFileEvent::Response& response) mutable {
@@ -454,10 +1601,10 @@ namespace event_loop {
         );
     }
 
-    void EventLoop::printFile(File file, const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit) {
+    Expected<> EventLoop::printFile(File file, const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit) {
         auto buffer = mBufferManager.allocate(string.size());
         memcpy(buffer.data(), string.data(), string.size());
-        writeFile(
+        return tryWriteFile(
             file,
             buffer,
             [buffer, callback = std::move(callback)](EventContext& context, const WriteFileEvent::Response& response) {
@@ -472,11 +1619,273 @@ namespace event_loop {
     }
 
     void EventLoop::printStdout(const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit) {
-        printFile(File::stdoutFile(), string, std::move(callback), submit);
+        tryPrintStdout(string, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryPrintStdout(const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit) {
+        return printFile(File::stdoutFile(), string, std::move(callback), submit);
     }
 
     void EventLoop::printStderr(const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit) {
-        printFile(File::stderrFile(), string, std::move(callback), submit);
+        tryPrintStderr(string, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryPrintStderr(const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit) {
+        return printFile(File::stderrFile(), string, std::move(callback), submit);
+    }
+
+    void EventLoop::cancelOperation(EventId id, SubmitGuard* submit) {
+        tryCancelOperation(id, submit).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryCancelOperation(EventId id, SubmitGuard* submit) {
+        if (mEvents.find(id) == mEvents.end()) {
+            return {};
+        }
+
+        return cancel(id, submit);
+    }
+
+    void EventLoop::onSignal(int signal, SignalEvent::Callback callback) {
+        tryOnSignal(signal, std::move(callback)).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryOnSignal(int signal, SignalEvent::Callback callback) {
+        auto result = updateSignalMask(signal, true);
+        if (!result) {
+            return result;
+        }
+
+        mSignalCallbacks[signal] = std::move(callback);
+
+        // A single read serves all signals, as the signalfd is updated in place
+        if (mEvents.find(mSignalEventId) == mEvents.end()) {
+            auto& event = createEvent<SignalEvent>(mSignalFile);
+            mSignalEventId = event.id;
+            return removeIfFailed(event.id, readSignals(event, nullptr));
+        }
+
+        return {};
+    }
+
+    void EventLoop::stopOnSignal(int signal) {
+        onSignal(signal, [](EventContext& context, const SignalEvent::Response& response) {
+            context.stopSource.request_stop();
+            return true;
+        });
+    }
+
+    Expected<> EventLoop::readSignals(SignalEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_read(*sqe, event.file.fd, event.signals, sizeof(event.signals), 0);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    Expected<> EventLoop::updateSignalMask(int signal, bool handled) {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, signal);
+
+        auto newMask = mSignalMask;
+        if (handled) {
+            sigaddset(&newMask, signal);
+        } else {
+            sigdelset(&newMask, signal);
+        }
+
+        // Block before the signalfd takes over, so that no signal is delivered in between
+        auto alreadyHandled = sigismember(&mSignalMask, signal) == 1;
+        auto wasBlocked = sigismember(&mPreviouslyBlockedSignals, signal) == 1;
+        if (handled && !alreadyHandled) {
+            sigset_t previousMask;
+            auto result = pthread_sigmask(SIG_BLOCK, &signals, &previousMask);
+            if (result != 0) {
+                return Error { "pthread_sigmask", -result };
+            }
+
+            wasBlocked = sigismember(&previousMask, signal) == 1;
+        }
+
+        auto signalFd = checkSystemCall(signalfd(mSignalFile.fd, &newMask, SFD_NONBLOCK | SFD_CLOEXEC), "signalfd");
+        if (!signalFd) {
+            if (handled && !alreadyHandled && !wasBlocked) {
+                pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+            }
+
+            return signalFd.error();
+        }
+
+        // Restores the state from before the signal was handled
+        if (!handled && !wasBlocked) {
+            pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+        }
+
+        if (handled && wasBlocked) {
+            sigaddset(&mPreviouslyBlockedSignals, signal);
+        } else {
+            sigdelset(&mPreviouslyBlockedSignals, signal);
+        }
+
+        mSignalFile = File { *signalFd };
+        mSignalMask = newMask;
+        return {};
+    }
+
+    void EventLoop::handleSignal(EventContext& context, const SignalEvent::Response& response) {
+        auto callbackIterator = mSignalCallbacks.find((int)response.info.ssi_signo);
+        if (callbackIterator == mSignalCallbacks.end()) {
+            return;
+        }
+
+        if (!callbackIterator->second(context, response)) {
+            mSignalCallbacks.erase((int)response.info.ssi_signo);
+            static_cast<void>(updateSignalMask((int)response.info.ssi_signo, false));
+        }
+    }
+
+    void EventLoop::watch(const std::filesystem::path& path, std::uint32_t mask, WatchEvent::Callback callback) {
+        tryWatch(path, mask, std::move(callback)).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryWatch(const std::filesystem::path& path, std::uint32_t mask, WatchEvent::Callback callback) {
+        if (!mWatchFile) {
+            auto watchFd = checkSystemCall(inotify_init1(IN_NONBLOCK | IN_CLOEXEC), "inotify_init1");
+            if (!watchFd) {
+                return watchFd.error();
+            }
+
+            mWatchFile = File { *watchFd };
+        }
+
+        // Adds to the events of an existing watch of the same path
+        auto watchDescriptor = checkSystemCall(inotify_add_watch(mWatchFile.fd, path.c_str(), mask | IN_MASK_ADD), "inotify_add_watch");
+        if (!watchDescriptor) {
+            return watchDescriptor.error();
+        }
+
+        mWatchers[*watchDescriptor].push_back(Watcher { mask, std::move(callback) });
+
+        // A single read serves all watches
+        if (mEvents.find(mWatchEventId) == mEvents.end()) {
+            auto& event = createEvent<WatchEvent>(mWatchFile);
+            mWatchEventId = event.id;
+            return removeIfFailed(event.id, readWatches(event, nullptr));
+        }
+
+        return {};
+    }
+
+    Expected<> EventLoop::readWatches(WatchEvent& event, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_read(*sqe, event.file.fd, event.buffer, sizeof(event.buffer), 0);
+        (*sqe)->user_data = event.id;
+
+        return submitRing(submit);
+    }
+
+    void EventLoop::handleWatch(EventContext& context, const WatchEvent::Response& response) {
+        // Events were lost, cached stats can no longer be trusted
+        if ((response.mask & IN_Q_OVERFLOW) != 0) {
+            clearFileStats();
+        }
+
+        auto watchersIterator = mWatchers.find(response.watchDescriptor);
+        if (watchersIterator == mWatchers.end()) {
+            return;
+        }
+
+        // The kernel removed the watch (e.g. the file was deleted), which all watchers are told about
+        auto removed = (response.mask & IN_IGNORED) != 0;
+
+        auto& watchers = watchersIterator->second;
+        for (auto watcher = watchers.begin(); watcher != watchers.end();) {
+            if (((watcher->mask & response.mask) != 0 || removed) && !watcher->callback(context, response)) {
+                watcher = watchers.erase(watcher);
+            } else {
+                ++watcher;
+            }
+        }
+
+        if (removed) {
+            mWatchers.erase(response.watchDescriptor);
+        } else if (watchers.empty()) {
+            inotify_rm_watch(mWatchFile.fd, response.watchDescriptor);
+            mWatchers.erase(response.watchDescriptor);
+        }
+    }
+
+    void EventLoop::follow(const std::filesystem::path& path, FollowCallback callback, std::size_t bufferSize) {
+        tryFollow(path, std::move(callback), bufferSize).valueOrThrow();
+    }
+
+    Expected<> EventLoop::tryFollow(const std::filesystem::path& path, FollowCallback callback, std::size_t bufferSize) {
+        auto fileFd = checkSystemCall(::open(path.c_str(), O_RDONLY | O_CLOEXEC), "open");
+        if (!fileFd) {
+            return fileFd.error();
+        }
+
+        // Starts from the current end
+        struct stat stats {};
+        if (::fstat(*fileFd, &stats) != 0) {
+            auto error = Error::fromErrorNumber("fstat");
+            ::close(*fileFd);
+            return error;
+        }
+
+        auto follower = std::make_shared<Follower>(File { *fileFd }, (std::uint64_t)stats.st_size, Buffer { bufferSize }, std::move(callback));
+
+        return tryWatch(path, IN_MODIFY, [follower](EventContext& context, const WatchEvent::Response& response) {
+            if (follower->stopped || (response.mask & IN_IGNORED) != 0) {
+                return false;
+            }
+
+            // Modifications during a read are picked up once it reaches the end
+            if (follower->reading) {
+                follower->modifiedWhileReading = true;
+            } else {
+                readAppended(context.eventLoop, follower);
+            }
+
+            return true;
+        });
+    }
+
+    Process EventLoop::spawn(std::span<const std::string> arguments, const SpawnOptions& options, WaitProcessOperation::Callback callback, SubmitGuard* submit) {
+        return trySpawn(arguments, options, std::move(callback), submit).valueOrThrow();
+    }
+
+    Expected<Process> EventLoop::trySpawn(std::span<const std::string> arguments, const SpawnOptions& options, WaitProcessOperation::Callback callback, SubmitGuard* submit) {
+        auto process = spawnProcess(arguments, options);
+        if (!process) {
+            return process.error();
+        }
+
+        auto result = trySubmitOperation(WaitProcessOperation { process->pid, std::move(callback) }, submit);
+        if (!result) {
+            // Nothing would reap the process
+            ::kill(process->pid, SIGKILL);
+            ::waitpid(process->pid, nullptr, 0);
+
+            for (auto file : { process->input, process->output, process->error }) {
+                if (file) {
+                    ::close(file->fd);
+                }
+            }
+
+            return result.error();
+        }
+
+        return process;
     }
 
     Buffer EventLoop::allocate(std::size_t size) {
@@ -487,18 +1896,136 @@ namespace event_loop {
         mBufferManager.deallocate(std::move(buffer));
     }
 
-    void EventLoop::submitRing(SubmitGuard* submit) {
+    std::pmr::memory_resource& EventLoop::connectionArena(Socket socket, std::size_t initialSize) {
+        auto arenaIterator = mConnectionArenas.find(socket.fd);
+        if (arenaIterator == mConnectionArenas.end()) {
+            std::pmr::polymorphic_allocator<ConnectionArena> allocator { mResource };
+            ConnectionArenaPointer arena {
+                allocator.new_object<ConnectionArena>(initialSize, mResource),
+                ResourceDeleter<ConnectionArena> { mResource }
+            };
+
+            arenaIterator = mConnectionArenas.emplace(socket.fd, std::move(arena)).first;
+        }
+
+        return *arenaIterator->second;
+    }
+
+    BufferManager::Stats EventLoop::bufferStats() const {
+        return mBufferManager.stats();
+    }
+
+    std::chrono::nanoseconds EventLoop::loopLatency() const {
+        return mLoopLatency;
+    }
+
+    void EventLoop::releaseConnection(Socket client) {
+        connectionClosed(client.fd);
+    }
+
+    void EventLoop::releaseConnectionArena(AnyFd fd) {
+        mConnectionArenas.erase(fd.fd);
+    }
+
+    Expected<> EventLoop::cancel(EventId id, SubmitGuard* submit) {
+        auto sqe = getSqe();
+        if (!sqe) {
+            return sqe.error();
+        }
+
+        io_uring_prep_cancel64(*sqe, id, 0);
+        (*sqe)->user_data = IgnoredEventId;
+
+        return submitRing(submit);
+    }
+
+    Expected<> EventLoop::submitRing(SubmitGuard* submit) {
         if (submit != nullptr) {
             submit->submit();
-        } else {
-            EventLoopException::throwIfFailed(io_uring_submit(&mRing), "io_uring_submit");
+            return {};
+        }
+
+        if (mSubmitBatching.enabled && holdSubmission()) {
+            return {};
+        }
+
+        return flushSubmissions();
+    }
+
+    bool EventLoop::holdSubmission() {
+        auto now = std::chrono::steady_clock::now();
+        if (mLastSubmission != std::chrono::steady_clock::time_point {}) {
+            auto interval = std::chrono::duration_cast<std::chrono::nanoseconds>(now - mLastSubmission);
+            mSubmitInterval += (interval - mSubmitInterval) / 8;
+        }
+        mLastSubmission = now;
+
+        // Holding only pays off if more operations are expected to arrive within the delay
+        auto batchSize = mSubmitBatching.maxPending;
+        if (mSubmitInterval.count() > 0) {
+            batchSize = std::min<std::size_t>(batchSize, (std::size_t)(mSubmitBatching.maxDelay / mSubmitInterval));
+        }
+
+        if (batchSize < 2) {
+            return false;
+        }
+
+        if (mPendingSubmissions == 0) {
+            mFirstPendingSubmission = now;
+        }
+
+        mPendingSubmissions++;
+        if (mPendingSubmissions >= batchSize || now - mFirstPendingSubmission >= mSubmitBatching.maxDelay) {
+            return false;
+        }
+
+        mMetrics.heldSubmissions++;
+        return true;
+    }
+
+    Expected<> EventLoop::flushSubmissions() {
+        // Submitting always includes all prepared operations
+        mPendingSubmissions = 0;
+
+        if (mRingOptions.autoResize) {
+            trackRingOccupancy();
+        }
+
+        mMetrics.submits++;
+        auto result = checkResult(io_uring_submit(&mRing), "io_uring_submit");
+        if (!result) {
+            return result.error();
+        }
+
+        return {};
+    }
+
+    const SubmitBatchingOptions& EventLoop::submitBatching() const {
+        return mSubmitBatching;
+    }
+
+    void EventLoop::setSubmitBatching(SubmitBatchingOptions options) {
+        mSubmitBatching = options;
+        if (!mSubmitBatching.enabled) {
+            static_cast<void>(flushSubmissions());
         }
     }
 
-    io_uring_sqe* EventLoop::getSqe() {
+    Expected<io_uring_sqe*> EventLoop::getSqe() {
         io_uring_sqe* sqe = io_uring_get_sqe(&mRing);
         if (sqe == nullptr) {
-            throw EventLoopException("io_uring_get_sqe", -1);
+            // The submission queue is full, flush it to the kernel to make room rather than failing
+            mMetrics.submissionQueueFull++;
+            mSubmissionQueueFullSinceCheck++;
+            auto result = flushSubmissions();
+            if (!result) {
+                return result.error();
+            }
+
+            sqe = io_uring_get_sqe(&mRing);
+            if (sqe == nullptr) {
+                return Error { "io_uring_get_sqe", -EBUSY };
+            }
         }
 
         return sqe;
@@ -507,4 +2034,12 @@ namespace event_loop {
     void EventLoop::removeEvent(EventId id) {
         mEvents.erase(id);
     }
-}
+
+    Expected<> EventLoop::removeIfFailed(EventId id, Expected<> result) {
+        if (!result) {
+            removeEvent(id);
+        }
+
+        return result;
+    }
+}
\ No newline at end of file
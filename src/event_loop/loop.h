@@ -3,9 +3,18 @@
 #include <cstdint>
 #include <exception>
 #include <string>
+#include <string_view>
 #include <stop_token>
 #include <unordered_map>
+#include <unordered_set>
+#include <typeindex>
+#include <map>
 #include <filesystem>
+#include <mutex>
+#include <span>
+#include <list>
+
+#include <signal.h>
 
 #include "fmt/format.h"
 
@@ -22,6 +31,12 @@
 #include "common.h"
 #include "events.h"
 #include "buffer.h"
+#include "future.h"
+#include "config.h"
+#include "metrics.h"
+#include "memory.h"
+#include "operation.h"
+#include "process.h"
 
 namespace event_loop {
     class TcpListener {
@@ -46,7 +61,63 @@ namespace event_loop {
         const sockaddr_un& address() const;
     };
 
+    /**
+     * Holds back operations submitted without a submit guard, so that they can share a single submit call
+     */
+    struct SubmitBatchingOptions {
+        bool enabled = false;
+
+        // The longest time an operation is held before being submitted
+        std::chrono::nanoseconds maxDelay = std::chrono::microseconds(20);
+
+        // The most operations held at once. The batch size used is lower when fewer operations arrive within the delay.
+        std::size_t maxPending = 32;
+    };
+
+    /**
+     * Caching of file stats (readFileStats), invalidated by watching the directories of the cached paths
+     */
+    struct FileStatsCacheOptions {
+        bool enabled = false;
+
+        // How long cached stats are used, bounding staleness for changes the watches do not report (e.g. network filesystems)
+        std::chrono::nanoseconds timeToLive = std::chrono::seconds(1);
+
+        // How long a missing file is remembered as missing
+        std::chrono::nanoseconds negativeTimeToLive = std::chrono::milliseconds(100);
+
+        // The most cached paths, above which stats are read without being cached
+        std::size_t maxEntries = 4096;
+    };
+
+    /**
+     * Sizes of the ring of an event loop
+     */
+    struct RingOptions {
+        // Number of submission queue entries
+        std::uint32_t depth = 256;
+
+        // Number of completion queue entries, zero for the kernel default (twice the depth)
+        std::uint32_t completionQueueSize = 0;
+
+        // Only submit from the thread running the loop, where completion work is deferred until the loop waits.
+        // Required for resizing the ring in place, otherwise it can only be recreated while no events are in flight.
+        bool singleIssuer = false;
+
+        // Grow the ring when the submission queue fills or completions overflow, and shrink it when mostly unused
+        bool autoResize = false;
+        std::uint32_t minDepth = 64;
+        std::uint32_t maxDepth = 4096;
+
+        // Number of iterations between resize decisions
+        std::uint32_t resizeCheckIterations = 4096;
+    };
+
     class EventLoop;
+
+    /**
+     * Submits the operations prepared with the guard together when destroyed, bypassing submission batching
+     */
     class SubmitGuard {
     private:
         EventLoop& mEventLoop;
@@ -61,22 +132,214 @@ namespace event_loop {
         void submit();
     };
 
+    /**
+     * Destroys events allocated from a memory resource
+     */
+    struct EventDeleter {
+        std::pmr::memory_resource* resource = nullptr;
+        std::size_t size = 0;
+        std::size_t alignment = 0;
+
+        void operator()(Event* event) const;
+    };
+
+    using EventPointer = std::unique_ptr<Event, EventDeleter>;
+
+    struct DispatchBatchPoolBase {
+        virtual ~DispatchBatchPoolBase() = default;
+    };
+
     class EventLoop {
     public:
         using DispatchedCallback = std::function<void (EventLoop&)>;
     private:
+        std::pmr::memory_resource* mResource;
+
         io_uring mRing {};
+        bool mRingFdRegistered = false;
 
-        EventId mNextEventId = 1;
-        std::unordered_map<EventId, std::unique_ptr<Event>> mEvents;
+        struct RingSize {
+            std::uint32_t depth = 0;
+            std::uint32_t completionQueueSize = 0;
+        };
 
-        std::mutex mDispatchMutex;
-        std::vector<DispatchedCallback> mDispatchQueue;
-        std::vector<DispatchedCallback> mExecutingDispatched;
+        RingOptions mRingOptions;
+        std::uint32_t mIterationsSinceResizeCheck = 0;
+        std::uint32_t mPeakSubmissionQueue = 0;
+        std::uint32_t mPeakCompletionQueue = 0;
+        std::size_t mSubmissionQueueFullSinceCheck = 0;
+        std::uint32_t mLastCompletionOverflow = 0;
 
+        // Before the events, as these can hold buffers allocated by the manager
         BufferManager mBufferManager;
+        BufferGroupIds mBufferGroupIds;
+
+        EventId mNextEventId = 1;
+        std::pmr::unordered_map<EventId, EventPointer> mEvents;
+
+        DispatchMutex mDispatchMutex;
+        std::pmr::vector<DispatchedCallback> mDispatchQueue;
+        std::pmr::vector<DispatchedCallback> mExecutingDispatched;
+
+        template<typename T, typename Handler>
+        struct DispatchBatchNode {
+            std::pmr::vector<T> items;
+            std::optional<Handler> handler;
+
+            explicit DispatchBatchNode(std::pmr::memory_resource* resource)
+                : items(resource) {
+
+            }
+        };
+
+        /**
+         * The storage of batched dispatches of one item and handler type, reused once a batch has been handled
+         */
+        template<typename Node>
+        struct DispatchBatchPool : public DispatchBatchPoolBase {
+            std::pmr::polymorphic_allocator<Node> allocator;
+            std::pmr::vector<Node*> nodes;
+            std::pmr::vector<Node*> free;
+
+            explicit DispatchBatchPool(std::pmr::memory_resource* resource)
+                : allocator(resource), nodes(resource), free(resource) {
+
+            }
+
+            ~DispatchBatchPool() override {
+                for (auto node : nodes) {
+                    allocator.delete_object(node);
+                }
+            }
+        };
+
+        // Guarded by the dispatch mutex
+        std::pmr::unordered_map<std::type_index, std::unique_ptr<DispatchBatchPoolBase>> mDispatchBatchPools;
+
+        template<typename Node>
+        DispatchBatchPool<Node>& dispatchBatchPool() {
+            auto& pool = mDispatchBatchPools[typeid(Node)];
+            if (!pool) {
+                pool = std::make_unique<DispatchBatchPool<Node>>(mResource);
+            }
+
+            return static_cast<DispatchBatchPool<Node>&>(*pool);
+        }
+
+        EventLoopMetrics mMetrics;
+
+        MonotonicArena mIterationArena;
+        std::pmr::unordered_map<Fd, ConnectionArenaPointer> mConnectionArenas;
+
+        struct SlackTimer {
+            TimerEvent::Clock::time_point deadline;
+            EventId id;
+        };
+
+        std::chrono::nanoseconds mDefaultTimerSlack { 0 };
+        std::chrono::nanoseconds mMaxTimerSlack { 0 };
+        std::pmr::multimap<TimerEvent::Clock::time_point, SlackTimer> mSlackTimers;
+        EventId mTimerWakeupId = IgnoredEventId;
+
+
+        SubmitBatchingOptions mSubmitBatching;
+        std::size_t mPendingSubmissions = 0;
+        std::chrono::steady_clock::time_point mFirstPendingSubmission;
+        std::chrono::steady_clock::time_point mLastSubmission;
+        std::chrono::nanoseconds mSubmitInterval { 0 };
+
+        // The accept event of connections counted by admission control
+        std::pmr::unordered_map<Fd, EventId> mAdmittedConnections;
+        bool mTrackLoopLatency = false;
+
+        using RearmFunction = Expected<> (*)(EventLoop& eventLoop, Event& event);
+
+        struct DeferredRearm {
+            EventId id;
+            RearmFunction rearm;
+        };
+
+        // Re-arms are deferred while completions overflow, until the completion queue has drained
+        bool mCompletionBackpressure = false;
+        std::uint32_t mDroppedCompletions = 0;
+        std::pmr::vector<DeferredRearm> mDeferredRearms;
+
+        // Signals are read from a single signalfd, created on first use
+        File mSignalFile { -1 };
+        EventId mSignalEventId = IgnoredEventId;
+        sigset_t mSignalMask {};
+
+        // Handled signals that were already blocked before, which stay blocked when no longer handled
+        sigset_t mPreviouslyBlockedSignals {};
+        std::pmr::unordered_map<int, SignalEvent::Callback> mSignalCallbacks;
+
+        // File watches share a single inotify fd, created on first use
+        struct Watcher {
+            std::uint32_t mask = 0;
+            WatchEvent::Callback callback;
+        };
+
+        File mWatchFile { -1 };
+        EventId mWatchEventId = IgnoredEventId;
+        std::pmr::unordered_map<int, std::pmr::list<Watcher>> mWatchers;
+
+        struct CachedFileStats {
+            std::optional<struct statx> stats;
+            Result result = 0;
+            std::chrono::steady_clock::time_point expires;
+        };
+
+        // Paths are looked up without copying them into keys
+        struct PathHash {
+            using is_transparent = void;
+
+            std::size_t operator()(std::string_view path) const {
+                return std::hash<std::string_view> {}(path);
+            }
+        };
+
+        struct PathEqual {
+            using is_transparent = void;
+
+            bool operator()(std::string_view path, std::string_view other) const {
+                return path == other;
+            }
+        };
+
+        template<typename T>
+        using PathMap = std::pmr::unordered_map<std::pmr::string, T, PathHash, PathEqual>;
+
+        FileStatsCacheOptions mFileStatsCacheOptions;
+        PathMap<CachedFileStats> mFileStatsCache;
+        std::pmr::unordered_set<std::pmr::string, PathHash, PathEqual> mStatsWatchedDirectories;
+
+        // Invalidations are numbered, where stats are not cached if their directory (or the whole cache) was invalidated
+        // while they were read. Tracked per directory, as invalidations elsewhere do not affect them.
+        PathMap<std::uint64_t> mStatsDirectoryGenerations;
+        std::uint64_t mFileStatsGeneration = 0;
+        std::uint64_t mFileStatsClearedGeneration = 0;
+
+        // The stop source of the last run, for callbacks completed without a completion (cache hits)
+        std::stop_source mStopSource;
+        std::chrono::nanoseconds mLoopLatency { 0 };
     public:
-        explicit EventLoop(std::uint32_t depth = 256);
+        /**
+         * Creates a new event loop, where all internal allocations are made from the given memory resource, except:
+         *  - Callbacks (std::function), which allocate on their own.
+         *  - The tasks of dispatchWithResult and the counting resource of the buffers, which can outlive the loop.
+         *  - The mirrored rings of receiveStream, whose data is mapped memory.
+         */
+        explicit EventLoop(
+            std::uint32_t depth = 256,
+            std::size_t iterationArenaSize = 64 * 1024,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+        );
+
+        explicit EventLoop(
+            RingOptions ring,
+            std::size_t iterationArenaSize = 64 * 1024,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+        );
         ~EventLoop();
 
         EventLoop(const EventLoop&) = delete;
@@ -86,80 +349,438 @@ namespace event_loop {
         bool runOnce(std::stop_source& stopSource, std::chrono::duration<double> maxDuration);
 
         /**
-         * Request the given callback (potentially from another thread) to be executed on the event loop thread
+         * Returns the metrics of the event loop (all zero unless Policy::collectMetrics)
+         */
+        const EventLoopMetrics& metrics() const;
+
+        /**
+         * Indicates if the ring fd is registered with the ring itself, saving a file lookup on each submit and wait
+         */
+        bool ringFdRegistered() const;
+
+        std::uint32_t ringDepth() const;
+        std::uint32_t completionQueueSize() const;
+
+        /**
+         * Resizes the ring (zero completion queue size for twice the depth). Done in place if supported, otherwise the ring is
+         * recreated, which fails with EBUSY unless the loop is idle (no events at all, including persistent ones).
+         * Returns true if the ring was resized.
+         */
+        Expected<bool> resizeRing(std::uint32_t depth, std::uint32_t completionQueueSize = 0);
+
+        /**
+         * Returns the allocator for transient allocations, released at the end of each iteration of the event loop
+         */
+        MonotonicArena& iterationArena();
+
+        /**
+         * Returns the memory resource used for internal allocations
+         */
+        std::pmr::memory_resource* resource() const;
+
+        /**
+         * Request the given callback (potentially from another thread) to be executed on the event loop thread.
+         * Only allowed from other threads if Policy::threadSafeDispatch.
          */
         void dispatch(DispatchedCallback callback);
 
+        /**
+         * Request the given callbacks (potentially from another thread) to be executed on the event loop thread
+         */
+        void dispatch(std::span<DispatchedCallback> callbacks);
+
+        /**
+         * Request the given handler (potentially from another thread) to be executed once on the event loop thread for all given items.
+         * The items are copied into storage reused across dispatches of the same item and handler type.
+         */
+        template<typename T, typename Handler>
+        void dispatch(std::span<const T> items, Handler handler) {
+            using Node = DispatchBatchNode<T, Handler>;
+
+            std::scoped_lock guard(mDispatchMutex);
+            auto& pool = dispatchBatchPool<Node>();
+
+            Node* node = nullptr;
+            if (pool.free.empty()) {
+                node = pool.allocator.template new_object<Node>(mResource);
+                pool.nodes.push_back(node);
+            } else {
+                node = pool.free.back();
+                pool.free.pop_back();
+            }
+
+            // Keeps the capacity of earlier batches
+            node->items.assign(items.begin(), items.end());
+            node->handler.emplace(std::move(handler));
+
+            // Only pointers are captured, which std::function stores without allocating
+            mDispatchQueue.push_back([node, &pool](EventLoop& eventLoop) {
+                (*node->handler)(eventLoop, std::span<const T>(node->items));
+                node->items.clear();
+                node->handler.reset();
+
+                std::scoped_lock guard(eventLoop.mDispatchMutex);
+                pool.free.push_back(node);
+            });
+        }
+
+        /**
+         * Request the given function (potentially from another thread) to be executed on the event loop thread.
+         * The returned future becomes ready with the return value of the function.
+         */
+        template<typename T, typename Function>
+        DispatchFuture<T> dispatchWithResult(Function function) {
+            auto task = new DispatchTask<T, Function>(std::move(function));
+            dispatch(DispatchTaskReference<T, Function> { task });
+
+            return DispatchFuture<T> { task };
+        }
+
         // Generic
+        void nop(NopEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryNop(NopEvent::Callback callback, SubmitGuard* submit = nullptr);
         void close(AnyFd fd, CloseEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryClose(AnyFd fd, CloseEvent::Callback callback, SubmitGuard* submit = nullptr);
 
         // Timer
         void timer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryTimer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        /**
+         * Creates a timer that may fire up to the slack later than the duration.
+         * Timers with overlapping windows are fired together by a single wakeup.
+         */
+        void timer(std::chrono::duration<double> duration, std::chrono::duration<double> slack, TimerEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryTimer(std::chrono::duration<double> duration, std::chrono::duration<double> slack, TimerEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        /**
+         * Creates a timer using the default timer slack, for timers where precision does not matter (heartbeats, retries)
+         */
+        void backgroundTimer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryBackgroundTimer(std::chrono::duration<double> duration, TimerEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        std::chrono::nanoseconds defaultTimerSlack() const;
+        void setDefaultTimerSlack(std::chrono::duration<double> slack);
+
+        const SubmitBatchingOptions& submitBatching() const;
+        void setSubmitBatching(SubmitBatchingOptions options);
+
+        /**
+         * Submits all operations held back by submission batching
+         */
+        Expected<> flushSubmissions();
+
+        const FileStatsCacheOptions& fileStatsCache() const;
+        void setFileStatsCache(FileStatsCacheOptions options);
+
+        /**
+         * Drops the cached stats of the given path, for changes the directory watches do not report
+         */
+        void invalidateFileStats(const std::filesystem::path& path);
 
         // Sockets
         TcpListener tcpListen(in_addr address, std::uint16_t port, int backlog = 32);
+        Expected<TcpListener> tryTcpListen(in_addr address, std::uint16_t port, int backlog = 32);
+        TcpListener tcpListen(in_addr address, std::uint16_t port, TcpListenOptions options);
+        Expected<TcpListener> tryTcpListen(in_addr address, std::uint16_t port, TcpListenOptions options);
         Socket udpReceiver(in_addr address, std::uint16_t port);
+        Expected<Socket> tryUdpReceiver(in_addr address, std::uint16_t port);
+        Socket udpReceiver(in_addr address, std::uint16_t port, UdpReceiverOptions options);
+        Expected<Socket> tryUdpReceiver(in_addr address, std::uint16_t port, UdpReceiverOptions options);
         UnixListener unixListen(const std::string& path, int backlog = 32);
+        Expected<UnixListener> tryUnixListen(const std::string& path, int backlog = 32);
 
         void accept(const TcpListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryAccept(const TcpListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit = nullptr);
         void accept(const UnixListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryAccept(const UnixListener& listener, AcceptEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        /**
+         * Accepts connections with admission control, pausing accepting (or rejecting connections) when the limits are exceeded
+         */
+        void accept(const TcpListener& listener, AdmissionOptions admission, AcceptEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryAccept(const TcpListener& listener, AdmissionOptions admission, AcceptEvent::Callback callback, SubmitGuard* submit = nullptr);
+        void accept(const UnixListener& listener, AdmissionOptions admission, AcceptEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryAccept(const UnixListener& listener, AdmissionOptions admission, AcceptEvent::Callback callback, SubmitGuard* submit = nullptr);
         void connect(in_addr_t address, std::uint16_t port, ConnectEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryConnect(in_addr_t address, std::uint16_t port, ConnectEvent::Callback callback, SubmitGuard* submit = nullptr);
         void connect(const std::string& path, ConnectEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryConnect(const std::string& path, ConnectEvent::Callback callback, SubmitGuard* submit = nullptr);
 
         void receive(Socket client, Buffer buffer, ReceiveEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryReceive(Socket client, Buffer buffer, ReceiveEvent::Callback callback, SubmitGuard* submit = nullptr);
+        /**
+         * Continuously receives datagrams (with their source address) using a multishot receive into buffers provided to the kernel
+         */
+        void receiveDatagrams(Socket socket, ReceiveDatagramsOptions options, ReceiveDatagramsEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryReceiveDatagrams(Socket socket, ReceiveDatagramsOptions options, ReceiveDatagramsEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        /**
+         * Receives continuously into a ring of (at least) the given capacity, where the unconsumed data is always contiguous.
+         * Once the ring is full, the callback is called with the result -ENOBUFS, and receiving stops unless it consumed data.
+         */
+        void receiveStream(Socket client, std::size_t capacity, ReceiveStreamEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryReceiveStream(Socket client, std::size_t capacity, ReceiveStreamEvent::Callback callback, SubmitGuard* submit = nullptr);
+
         void send(Socket client, Buffer data, SendEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> trySend(Socket client, Buffer data, SendEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        /**
+         * Sends the given datagram to the given destination
+         */
+        void sendTo(Socket socket, SocketAddress destination, Buffer data, SendToEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> trySendTo(Socket socket, SocketAddress destination, Buffer data, SendToEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        /**
+         * Sends the given datagrams to the same destination, packing runs of equally sized datagrams into single messages
+         * using UDP segmentation offload. The callback is called once per sent message. Messages rejected by the socket
+         * (EINVAL or EIO, e.g. without offload support or exceeding the path MTU) are sent again one datagram at a time.
+         * If submitting fails, the messages before were already submitted and their callbacks are still called.
+         */
+        void sendToBatch(Socket socket, SocketAddress destination, std::span<const Buffer> datagrams, SendToEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> trySendToBatch(Socket socket, SocketAddress destination, std::span<const Buffer> datagrams, SendToEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        /**
+         * Sends the given datagrams, where consecutive datagrams to the same destination are batched (see sendToBatch).
+         * All messages are submitted together, where a failure leaves the messages before it submitted.
+         */
+        void sendToMany(Socket socket, std::span<const Datagram> datagrams, SendToEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> trySendToMany(Socket socket, std::span<const Datagram> datagrams, SendToEvent::Callback callback, SubmitGuard* submit = nullptr);
 
         // File
         void openFile(std::filesystem::path path, OpenFileEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryOpenFile(std::filesystem::path path, OpenFileEvent::Callback callback, SubmitGuard* submit = nullptr);
         void openFile(std::filesystem::path path, int flags, mode_t mode, OpenFileEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryOpenFile(std::filesystem::path path, int flags, mode_t mode, OpenFileEvent::Callback callback, SubmitGuard* submit = nullptr);
         void readFile(File file, Buffer buffer, std::uint64_t offset, ReadFileEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryReadFile(File file, Buffer buffer, std::uint64_t offset, ReadFileEvent::Callback callback, SubmitGuard* submit = nullptr);
         void writeFile(File file, Buffer data, WriteFileEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryWriteFile(File file, Buffer data, WriteFileEvent::Callback callback, SubmitGuard* submit = nullptr);
         void readFileStats(std::filesystem::path path, ReadFileStatsEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryReadFileStats(std::filesystem::path path, ReadFileStatsEvent::Callback callback, SubmitGuard* submit = nullptr);
 
         // Standard I/O
         void readLine(Buffer buffer, ReadLineEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryReadLine(Buffer buffer, ReadLineEvent::Callback callback, SubmitGuard* submit = nullptr);
         void printStdout(const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryPrintStdout(const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit = nullptr);
         void printStderr(const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<> tryPrintStderr(const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit = nullptr);
+
+        // User defined
+        /**
+         * Submits the given user defined operation, returning the id of its event
+         */
+        template<Operation T>
+        EventId submitOperation(T operation, SubmitGuard* submit = nullptr) {
+            return trySubmitOperation(std::move(operation), submit).valueOrThrow();
+        }
+
+        template<Operation T>
+        Expected<EventId> trySubmitOperation(T operation, SubmitGuard* submit = nullptr) {
+            auto& event = createEvent<OperationEvent<T>>(std::move(operation));
+            auto result = removeIfFailed(event.id, submitOperation(event, submit));
+            if (!result) {
+                return result.error();
+            }
+
+            return event.id;
+        }
+
+        /**
+         * Requests the given user defined operation to be cancelled, where it completes with -ECANCELED unless it already
+         * completed
+         */
+        void cancelOperation(EventId id, SubmitGuard* submit = nullptr);
+        Expected<> tryCancelOperation(EventId id, SubmitGuard* submit = nullptr);
+
+        /**
+         * Handles the given signal on the loop, by blocking it for the calling thread and reading it through a signalfd.
+         * Should be called before starting other threads, as they inherit the blocked signals. Signals received multiple
+         * times before being handled are coalesced into a single call. If the callback returns false or the loop is destroyed
+         * (on the same thread), the signal is unblocked again unless it was blocked before.
+         */
+        void onSignal(int signal, SignalEvent::Callback callback);
+        Expected<> tryOnSignal(int signal, SignalEvent::Callback callback);
+
+        /**
+         * Requests the loop to stop (through the stop source passed to run) when receiving the given signal
+         */
+        void stopOnSignal(int signal);
+
+        /**
+         * Watches the given path for the given events (IN_* flags). Watches of the same path share a single kernel watch.
+         * Returning false from the callback removes the watch.
+         */
+        void watch(const std::filesystem::path& path, std::uint32_t mask, WatchEvent::Callback callback);
+        Expected<> tryWatch(const std::filesystem::path& path, std::uint32_t mask, WatchEvent::Callback callback);
+
+        using FollowCallback = std::function<bool (EventContext& context, std::span<const std::uint8_t> data)>;
+
+        /**
+         * Follows the given file (like tail -f), calling the callback with the data appended after its current end.
+         * Returning false from the callback stops following. Starts over from the beginning if the file is truncated.
+         */
+        void follow(const std::filesystem::path& path, FollowCallback callback, std::size_t bufferSize = 64 * 1024);
+        Expected<> tryFollow(const std::filesystem::path& path, FollowCallback callback, std::size_t bufferSize = 64 * 1024);
+
+        /**
+         * Spawns the given program, calling the callback when it has exited. The piped streams of the process are closed by the caller.
+         */
+        Process spawn(std::span<const std::string> arguments, const SpawnOptions& options, WaitProcessOperation::Callback callback, SubmitGuard* submit = nullptr);
+        Expected<Process> trySpawn(std::span<const std::string> arguments, const SpawnOptions& options, WaitProcessOperation::Callback callback, SubmitGuard* submit = nullptr);
 
         Buffer allocate(std::size_t size);
         void deallocate(Buffer buffer);
+        BufferManager::Stats bufferStats() const;
+
+        /**
+         * The average time spent handling an iteration, only measured when used by admission control
+         */
+        std::chrono::nanoseconds loopLatency() const;
+
+        /**
+         * Returns the memory arena of the given connection, created on first use.
+         * All its allocations are released at once when the connection is closed through close.
+         */
+        std::pmr::memory_resource& connectionArena(Socket socket, std::size_t initialSize = 4096);
+
+        /**
+         * Releases the memory arena of the given connection, for connections not closed through close
+         */
+        void releaseConnectionArena(AnyFd fd);
+
+        /**
+         * Releases the admission slot (see AdmissionOptions) of the given accepted connection, for connections not closed
+         * through close. Otherwise the slot is only released once the descriptor is reused by another accepted connection.
+         */
+        void releaseConnection(Socket client);
     private:
         friend class SubmitGuard;
 
         friend class TimerEvent;
+        friend class TimerWakeupEvent;
         friend class ReceiveEvent;
         friend class AcceptEvent;
         friend class ReadFileEvent;
+        friend class ReceiveDatagramsEvent;
+        friend class ReceiveStreamEvent;
+        friend class SignalEvent;
+        friend class WatchEvent;
+
+        template<Operation T>
+        friend struct OperationEvent;
 
         void executeDispatched();
 
-        void close(CloseEvent& event, SubmitGuard* submit);
+        Expected<> nop(NopEvent& event, SubmitGuard* submit);
+        Expected<> close(CloseEvent& event, SubmitGuard* submit);
+
+        Expected<> timer(TimerEvent& event, SubmitGuard* submit);
+        Expected<> slackTimer(TimerEvent& event, SubmitGuard* submit);
+        Expected<> armTimerWakeup(SubmitGuard* submit);
+        void expireSlackTimers(EventContext& context, EventId wakeupId);
+
+        Expected<> accept(AcceptEvent& event, SubmitGuard* submit);
+        bool admitConnection(AcceptEvent& event, Socket client);
+        bool shouldPauseAccept(const AcceptEvent& event) const;
+        Expected<> rearmAccept(AcceptEvent& event);
+        bool checkPausedAccept(EventId id);
+        void connectionClosed(Fd fd);
+        Expected<> connect(ConnectEvent& event, SubmitGuard* submit);
+        Expected<> receive(ReceiveEvent& event, SubmitGuard* submit);
+        Expected<> receiveDatagrams(ReceiveDatagramsEvent& event, SubmitGuard* submit);
+        Expected<> receiveStream(ReceiveStreamEvent& event, SubmitGuard* submit);
+        Expected<> readSignals(SignalEvent& event, SubmitGuard* submit);
+        Expected<> updateSignalMask(int signal, bool handled);
+        void handleSignal(EventContext& context, const SignalEvent::Response& response);
+        Expected<> readWatches(WatchEvent& event, SubmitGuard* submit);
+        void handleWatch(EventContext& context, const WatchEvent::Response& response);
+        Expected<> send(SendEvent& event, SubmitGuard* submit);
+        Expected<> sendTo(SendToEvent& event, SubmitGuard* submit);
+        Expected<> sendSegmented(Socket socket, const SocketAddress& destination, std::span<const Buffer> datagrams, const SendToEvent::Callback& callback, SubmitGuard& submit);
+
+        Expected<> openFile(OpenFileEvent& event, SubmitGuard* submit);
+        Expected<> readFile(ReadFileEvent& event, SubmitGuard* submit);
+        Expected<> writeFile(WriteFileEvent& event, SubmitGuard* submit);
+        Expected<> readFileStats(ReadFileStatsEvent& event, SubmitGuard* submit);
+        Expected<> readCachedFileStats(std::filesystem::path path, ReadFileStatsEvent::Callback callback, SubmitGuard* submit);
+        void cacheFileStats(std::string_view key, std::uint64_t generation, Result result, const std::optional<struct statx>& stats);
+        bool watchStatsDirectory(std::string_view directory);
+        void invalidateStatsDirectory(std::string_view directory);
+        void invalidateStatsGeneration(std::string_view directory);
+        void clearFileStats();
+
+        template<Operation T>
+        Expected<> submitOperation(OperationEvent<T>& event, SubmitGuard* submit) {
+            auto sqe = getSqe();
+            if (!sqe) {
+                return sqe.error();
+            }
+
+            event.operation.prepare(*sqe);
+            (*sqe)->user_data = event.id;
+
+            return submitRing(submit);
+        }
+
+        Expected<> printFile(File file, const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit);
 
-        void timer(TimerEvent& event, SubmitGuard* submit);
+        /**
+         * Requests the operation of the given event to be cancelled, the completion of the cancellation is ignored
+         */
+        Expected<> cancel(EventId id, SubmitGuard* submit);
 
-        void accept(AcceptEvent& event, SubmitGuard* submit);
-        void connect(ConnectEvent& event, SubmitGuard* submit);
-        void receive(ReceiveEvent& event, SubmitGuard* submit);
-        void send(SendEvent& event, SubmitGuard* submit);
+        io_uring_params ringParameters(RingSize size, bool resize) const;
+        Expected<> recreateRing(RingSize size);
+        void trackRingOccupancy();
+        void checkCompletionOverflow();
 
-        void openFile(OpenFileEvent& event, SubmitGuard* submit);
-        void readFile(ReadFileEvent& event, SubmitGuard* submit);
-        void writeFile(WriteFileEvent& event, SubmitGuard* submit);
-        void readFileStats(ReadFileStatsEvent& event, SubmitGuard* submit);
+        /**
+         * Re-arms a multishot (or repeating) operation, deferred while there is completion backpressure
+         */
+        bool rearm(Event& event, RearmFunction rearm);
+        void checkRingSize();
 
-        void printFile(File file, const std::string_view& string, WriteFileEvent::Callback callback, SubmitGuard* submit);
+        Expected<> submitRing(SubmitGuard* submit);
+        bool holdSubmission();
+        Expected<io_uring_sqe*> getSqe();
 
-        void submitRing(SubmitGuard* submit);
-        io_uring_sqe* getSqe();
+        // Reserved for operations whose completions are ignored
+        static constexpr EventId IgnoredEventId = 0;
 
         template<typename T, typename ...Args>
         T& createEvent(Args&&... args) {
             auto id = mNextEventId;
             mNextEventId++;
-            auto [iterator, _] = mEvents.emplace(id, std::make_unique<T>(id, std::forward<Args>(args)...));
-            return *(T*)iterator->second.get();
+            std::pmr::polymorphic_allocator<T> allocator { mResource };
+            auto event = allocator.allocate(1);
+            new (event) T(id, std::forward<Args>(args)...);
+
+            mEvents.emplace(id, EventPointer { event, EventDeleter { mResource, sizeof(T), alignof(T) } });
+            return *event;
         }
 
         void removeEvent(EventId id);
+
+        /**
+         * Removes the given event if it failed to be submitted
+         */
+        Expected<> removeIfFailed(EventId id, Expected<> result);
     };
+
+    template<Operation T>
+    bool OperationEvent<T>::handle(EventContext& context) {
+        if (!operation.complete(context)) {
+            return false;
+        }
+
+        if (context.hasMore()) {
+            return true;
+        }
+
+        return context.eventLoop.rearm(*this, [](EventLoop& eventLoop, Event& event) {
+            return eventLoop.submitOperation(static_cast<OperationEvent<T>&>(event), nullptr);
+        });
+    }
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "memory.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace event_loop {
+    MonotonicArena::MonotonicArena(std::size_t capacity, std::pmr::memory_resource* upstream)
+        : mUpstream(upstream),
+          mCapacity(capacity),
+          mBlock((std::byte*)upstream->allocate(capacity, alignof(std::max_align_t))) {
+        mStats.capacity = capacity;
+    }
+
+    MonotonicArena::~MonotonicArena() {
+        reset();
+        mUpstream->deallocate(mBlock, mCapacity, alignof(std::max_align_t));
+    }
+
+    void* MonotonicArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+        auto current = (std::uintptr_t)(mBlock + mOffset);
+        auto aligned = (current + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+        auto end = aligned + bytes;
+
+        void* pointer = nullptr;
+        if (end <= (std::uintptr_t)(mBlock + mCapacity)) {
+            mOffset = end - (std::uintptr_t)mBlock;
+            pointer = (void*)aligned;
+        } else {
+            // Place the header in front of the allocation, keeping the allocation aligned
+            alignment = std::max(alignment, alignof(SpilledHeader));
+            auto headerSize = ((sizeof(SpilledHeader) + alignment - 1) / alignment) * alignment;
+
+            auto allocation = (std::byte*)mUpstream->allocate(headerSize + bytes, alignment);
+            auto header = (SpilledHeader*)(allocation + headerSize - sizeof(SpilledHeader));
+            header->next = mSpilled;
+            header->allocation = allocation;
+            header->size = headerSize + bytes;
+            header->alignment = alignment;
+            mSpilled = header;
+
+            mSpilledUsed += bytes;
+            mStats.spilledAllocations++;
+            mStats.spilledBytes += bytes;
+            pointer = allocation + headerSize;
+        }
+
+        mStats.used = mOffset + mSpilledUsed;
+        mStats.highWater = std::max(mStats.highWater, mStats.used);
+        return pointer;
+    }
+
+    void MonotonicArena::do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) {
+
+    }
+
+    bool MonotonicArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+        return this == &other;
+    }
+
+    void MonotonicArena::reset() {
+        while (mSpilled != nullptr) {
+            auto next = mSpilled->next;
+            mUpstream->deallocate(mSpilled->allocation, mSpilled->size, mSpilled->alignment);
+            mSpilled = next;
+        }
+
+        mOffset = 0;
+        mSpilledUsed = 0;
+        mStats.used = 0;
+        mStats.resets++;
+    }
+
+    const MonotonicArena::Stats& MonotonicArena::stats() const {
+        return mStats;
+    }
+
+    void CountingResourceReleaser::operator()(CountingResource* resource) const {
+        resource->release();
+    }
+
+    CountingResource::CountingResource(std::pmr::memory_resource* upstream)
+        : mUpstream(upstream) {
+
+    }
+
+    CountingResourcePointer CountingResource::create(std::pmr::memory_resource* upstream) {
+        return CountingResourcePointer { new CountingResource(upstream) };
+    }
+
+    void CountingResource::release() {
+        if (mReferences.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    void* CountingResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+        auto pointer = mUpstream->allocate(bytes, alignment);
+        mAllocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        mAllocations.fetch_add(1, std::memory_order_relaxed);
+        mReferences.fetch_add(1, std::memory_order_relaxed);
+        return pointer;
+    }
+
+    void CountingResource::do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) {
+        mUpstream->deallocate(pointer, bytes, alignment);
+        mAllocatedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+        mAllocations.fetch_sub(1, std::memory_order_relaxed);
+
+        // Last, as this can delete the resource
+        release();
+    }
+
+    bool CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* CountingResource::upstream() const {
+        return mUpstream;
+    }
+
+    std::size_t CountingResource::allocatedBytes() const {
+        return mAllocatedBytes.load(std::memory_order_relaxed);
+    }
+
+    std::size_t CountingResource::allocations() const {
+        return mAllocations.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+namespace event_loop {
+    /**
+     * Bump pointer allocator over a fixed block of memory, where deallocation is a no-op and all memory is released by reset.
+     * Allocations not fitting in the block spill to the upstream resource and are freed by reset.
+     */
+    class MonotonicArena : public std::pmr::memory_resource {
+    public:
+        struct Stats {
+            // The size of the block
+            std::size_t capacity = 0;
+
+            // Bytes currently allocated (including spilled)
+            std::size_t used = 0;
+
+            // The most bytes allocated between two resets (including spilled)
+            std::size_t highWater = 0;
+
+            // Number of allocations that did not fit in the block
+            std::size_t spilledAllocations = 0;
+
+            // Number of bytes that did not fit in the block
+            std::size_t spilledBytes = 0;
+
+            // Number of resets
+            std::size_t resets = 0;
+        };
+    private:
+        struct SpilledHeader {
+            SpilledHeader* next = nullptr;
+            void* allocation = nullptr;
+            std::size_t size = 0;
+            std::size_t alignment = 0;
+        };
+
+        std::pmr::memory_resource* mUpstream;
+
+        std::size_t mCapacity = 0;
+        std::byte* mBlock = nullptr;
+        std::size_t mOffset = 0;
+
+        SpilledHeader* mSpilled = nullptr;
+        std::size_t mSpilledUsed = 0;
+
+        Stats mStats;
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    public:
+        explicit MonotonicArena(std::size_t capacity, std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+        ~MonotonicArena() override;
+
+        MonotonicArena(const MonotonicArena&) = delete;
+        MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+        /**
+         * Releases all allocations made since the last reset
+         */
+        void reset();
+
+        const Stats& stats() const;
+    };
+
+    class CountingResource;
+
+    struct CountingResourceReleaser {
+        void operator()(CountingResource* resource) const;
+    };
+
+    using CountingResourcePointer = std::unique_ptr<CountingResource, CountingResourceReleaser>;
+
+    /**
+     * Forwards to the upstream resource, counting the bytes currently allocated.
+     * Deallocation may happen from any thread. Kept alive by its owner and by every live allocation, so allocations
+     * may outlive the owner.
+     */
+    class CountingResource : public std::pmr::memory_resource {
+    private:
+        std::pmr::memory_resource* mUpstream;
+        std::atomic<std::size_t> mAllocatedBytes { 0 };
+        std::atomic<std::size_t> mAllocations { 0 };
+
+        // The owner and the live allocations
+        std::atomic<std::size_t> mReferences { 1 };
+
+        explicit CountingResource(std::pmr::memory_resource* upstream);
+        void release();
+
+        friend struct CountingResourceReleaser;
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    public:
+        static CountingResourcePointer create(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+        CountingResource(const CountingResource&) = delete;
+        CountingResource& operator=(const CountingResource&) = delete;
+
+        std::pmr::memory_resource* upstream() const;
+
+        std::size_t allocatedBytes() const;
+        std::size_t allocations() const;
+    };
+
+    /**
+     * Deletes objects allocated from a memory resource
+     */
+    template<typename T>
+    struct ResourceDeleter {
+        std::pmr::memory_resource* resource = nullptr;
+
+        void operator()(T* pointer) const {
+            std::pmr::polymorphic_allocator<T>(resource).delete_object(pointer);
+        }
+    };
+
+    /**
+     * Chunked arena for allocations tied to a connection, where all memory is released at once when the arena is destroyed
+     */
+    using ConnectionArena = std::pmr::monotonic_buffer_resource;
+    using ConnectionArenaPointer = std::unique_ptr<ConnectionArena, ResourceDeleter<ConnectionArena>>;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "config.h"
+
+namespace event_loop {
+    /**
+     * Metrics of an event loop, all zero if not collected (see Policy::collectMetrics)
+     */
+    struct EventLoopMetrics {
+        // Number of calls to runOnce
+        Counter iterations;
+
+        // Number of handled completions
+        Counter completions;
+
+        // Number of io_uring_submit calls
+        Counter submits;
+
+        // Number of operations held back by submission batching instead of being submitted right away
+        Counter heldSubmissions;
+
+        // Number of times the submission queue was full when preparing an operation
+        Counter submissionQueueFull;
+
+        // Number of times completions overflowed the completion queue and were flushed from the kernel's backlog
+        Counter completionOverflows;
+
+        // Number of completions the kernel dropped as it could not even keep them in its backlog
+        Counter droppedCompletions;
+
+        // Number of multishot or repeating operations whose re-arm was deferred due to completion backpressure
+        Counter deferredRearms;
+
+        // Number of times the ring was resized (in place or recreated)
+        Counter ringResizes;
+
+        // Number of executed dispatched callbacks
+        Counter dispatched;
+
+        // Number of wakeups shared by timers with slack
+        Counter timerWakeups;
+
+        // Number of timers with slack fired by the shared wakeups
+        Counter coalescedTimers;
+
+        // Number of readFileStats calls completed from the cache
+        Counter fileStatsCacheHits;
+
+        // Number of readFileStats calls that read the stats while caching was enabled
+        Counter fileStatsCacheMisses;
+
+        // Number of times accepting was paused by admission control
+        Counter acceptPauses;
+
+        // Number of connections closed right away by admission control
+        Counter rejectedConnections;
+    };
+}
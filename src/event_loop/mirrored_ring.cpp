@@ -0,0 +1,80 @@
+#include "mirrored_ring.h"
+
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace event_loop {
+    MirroredRingBuffer::MirroredRingBuffer(std::size_t capacity)
+        : mCapacity(capacity) {
+
+    }
+
+    Expected<std::unique_ptr<MirroredRingBuffer>> MirroredRingBuffer::create(std::size_t capacity) {
+        auto pageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+        capacity = std::max(((capacity + pageSize - 1) / pageSize) * pageSize, pageSize);
+
+        auto memoryFd = checkSystemCall(memfd_create("event_loop_ring", MFD_CLOEXEC), "memfd_create");
+        if (!memoryFd) {
+            return memoryFd.error();
+        }
+
+        auto result = checkSystemCall(ftruncate(*memoryFd, (off_t)capacity), "ftruncate");
+        if (!result) {
+            ::close(*memoryFd);
+            return result.error();
+        }
+
+        // Reserve the address range for both mappings, then map the same pages into each half
+        auto reserved = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) {
+            auto error = Error::fromErrorNumber("mmap");
+            ::close(*memoryFd);
+            return error;
+        }
+
+        auto data = (std::uint8_t*)reserved;
+        for (auto half : { data, data + capacity }) {
+            if (mmap(half, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, *memoryFd, 0) == MAP_FAILED) {
+                auto error = Error::fromErrorNumber("mmap");
+                munmap(reserved, 2 * capacity);
+                ::close(*memoryFd);
+                return error;
+            }
+        }
+
+        // The mappings keep the memory alive
+        ::close(*memoryFd);
+
+        std::unique_ptr<MirroredRingBuffer> ring { new MirroredRingBuffer(capacity) };
+        ring->mData = data;
+        return ring;
+    }
+
+    MirroredRingBuffer::~MirroredRingBuffer() {
+        if (mData != nullptr) {
+            munmap(mData, 2 * mCapacity);
+        }
+    }
+
+    std::size_t MirroredRingBuffer::capacity() const {
+        return mCapacity;
+    }
+
+    std::span<const std::uint8_t> MirroredRingBuffer::readable() const {
+        return { mData + mRead % mCapacity, (std::size_t)(mWritten - mRead) };
+    }
+
+    void MirroredRingBuffer::consume(std::size_t size) {
+        mRead += std::min<std::uint64_t>(size, mWritten - mRead);
+    }
+
+    std::span<std::uint8_t> MirroredRingBuffer::writable() const {
+        return { mData + mWritten % mCapacity, (std::size_t)(mCapacity - (mWritten - mRead)) };
+    }
+
+    void MirroredRingBuffer::commit(std::size_t size) {
+        mWritten += std::min<std::uint64_t>(size, mCapacity - (mWritten - mRead));
+    }
+}
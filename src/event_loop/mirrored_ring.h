@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "common.h"
+
+namespace event_loop {
+    /**
+     * Byte ring buffer where the memory is mapped twice back to back, so both the readable and the writable region are
+     * always contiguous in virtual memory, even when wrapping around the end of the ring
+     */
+    class MirroredRingBuffer {
+    private:
+        std::uint8_t* mData = nullptr;
+        std::size_t mCapacity = 0;
+
+        // Total bytes written and read, the positions in the ring are these modulo the capacity
+        std::uint64_t mWritten = 0;
+        std::uint64_t mRead = 0;
+
+        explicit MirroredRingBuffer(std::size_t capacity);
+    public:
+        /**
+         * Creates a new ring of at least the given capacity, rounded up to whole pages
+         */
+        static Expected<std::unique_ptr<MirroredRingBuffer>> create(std::size_t capacity);
+        ~MirroredRingBuffer();
+
+        MirroredRingBuffer(const MirroredRingBuffer&) = delete;
+        MirroredRingBuffer& operator=(const MirroredRingBuffer&) = delete;
+
+        std::size_t capacity() const;
+
+        /**
+         * Returns the data that has been written but not yet consumed
+         */
+        std::span<const std::uint8_t> readable() const;
+
+        /**
+         * Marks the given number of bytes at the start of the readable data as read
+         */
+        void consume(std::size_t size);
+
+        /**
+         * Returns the free region that can be written to
+         */
+        std::span<std::uint8_t> writable() const;
+
+        /**
+         * Marks the given number of bytes at the start of the writable region as written
+         */
+        void commit(std::size_t size);
+    };
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <concepts>
+#include <string>
+
+#include <liburing.h>
+
+#include "common.h"
+
+namespace event_loop {
+    /**
+     * A user defined operation, submitted through EventLoop::submitOperation. The operation provides:
+     *  - void prepare(io_uring_sqe* sqe): prepares the submission (user data is set by the event loop).
+     *  - bool complete(EventContext& context): handles a completion, returning true to keep the operation.
+     *    A kept operation is prepared and submitted again, unless more completions are coming (multishot).
+     *  - Optionally a static name, used for debugging.
+     */
+    template<typename T>
+    concept Operation = requires(T operation, io_uring_sqe* sqe, EventContext& context) {
+        { operation.prepare(sqe) };
+        { operation.complete(context) } -> std::convertible_to<bool>;
+    };
+
+    template<Operation T>
+    struct OperationEvent : public TypedEvent<OperationEvent<T>> {
+        T operation;
+
+        OperationEvent(EventId id, T operation)
+            : TypedEvent<OperationEvent<T>>(id),
+              operation(std::move(operation)) {
+
+        }
+
+        std::string name() const override {
+            if constexpr (requires { T::name; }) {
+                return T::name;
+            } else {
+                return "Operation";
+            }
+        }
+
+        bool handle(EventContext& context);
+    };
+}
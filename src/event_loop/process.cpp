@@ -0,0 +1,165 @@
+#include "process.h"
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace event_loop {
+    namespace {
+        struct Pipe {
+            int read = -1;
+            int write = -1;
+        };
+
+        void closeIfOpen(int fd) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+
+        /**
+         * Redirects the given standard stream of the child to the child's end of the pipe
+         */
+        void redirect(posix_spawn_file_actions_t& actions, int childEnd, int target) {
+            posix_spawn_file_actions_adddup2(&actions, childEnd, target);
+        }
+    }
+
+    Expected<Process> spawnProcess(std::span<const std::string> arguments, const SpawnOptions& options) {
+        if (arguments.empty()) {
+            return Error { "posix_spawnp", -EINVAL };
+        }
+
+        // Both ends close on exec, the dup2 in the child clears the flag for the standard streams
+        Pipe input;
+        Pipe output;
+        Pipe error;
+        auto closePipes = [&]() {
+            for (auto pipe : { input, output, error }) {
+                closeIfOpen(pipe.read);
+                closeIfOpen(pipe.write);
+            }
+        };
+
+        for (auto [enabled, pipe] : { std::pair { options.pipeInput, &input }, { options.pipeOutput, &output }, { options.pipeError, &error } }) {
+            if (!enabled) {
+                continue;
+            }
+
+            int fds[2];
+            auto result = checkSystemCall(pipe2(fds, O_CLOEXEC), "pipe2");
+            if (!result) {
+                closePipes();
+                return result.error();
+            }
+
+            pipe->read = fds[0];
+            pipe->write = fds[1];
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        if (options.pipeInput) {
+            redirect(actions, input.read, STDIN_FILENO);
+        }
+
+        if (options.pipeOutput) {
+            redirect(actions, output.write, STDOUT_FILENO);
+        }
+
+        if (options.pipeError) {
+            redirect(actions, error.write, STDERR_FILENO);
+        }
+
+        if (options.workingDirectory) {
+            posix_spawn_file_actions_addchdir_np(&actions, options.workingDirectory->c_str());
+        }
+
+        std::vector<char*> argv;
+        argv.reserve(arguments.size() + 1);
+        for (auto& argument : arguments) {
+            argv.push_back(const_cast<char*>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        std::vector<char*> envp;
+        if (options.environment) {
+            envp.reserve(options.environment->size() + 1);
+            for (auto& variable : *options.environment) {
+                envp.push_back(const_cast<char*>(variable.c_str()));
+            }
+            envp.push_back(nullptr);
+        }
+
+        pid_t pid = -1;
+        auto spawnResult = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), options.environment ? envp.data() : environ);
+        posix_spawn_file_actions_destroy(&actions);
+
+        if (spawnResult != 0) {
+            closePipes();
+            return Error { "posix_spawnp", -spawnResult };
+        }
+
+        // Only the parent's ends remain open in the parent
+        closeIfOpen(input.read);
+        closeIfOpen(output.write);
+        closeIfOpen(error.write);
+
+        Process process;
+        process.pid = pid;
+        if (options.pipeInput) {
+            process.input = File { input.write };
+        }
+
+        if (options.pipeOutput) {
+            process.output = File { output.read };
+        }
+
+        if (options.pipeError) {
+            process.error = File { error.read };
+        }
+
+        return process;
+    }
+
+    void WaitProcessOperation::prepare(io_uring_sqe* sqe) {
+        io_uring_prep_waitid(sqe, P_PID, (id_t)pid, &info, WEXITED, 0);
+    }
+
+    bool WaitProcessOperation::complete(EventContext& context) {
+        if (!callback) {
+            return false;
+        }
+
+        if (context.result == -EINTR) {
+            info = {};
+            return true;
+        }
+
+        ProcessExit exit { pid };
+        if (context.result < 0) {
+            info = {};
+
+            // A process that has not exited yet is reported as not found (si_pid stays zero)
+            auto result = checkSystemCall(waitid(P_PID, (id_t)pid, &info, WEXITED | WNOHANG), "waitid");
+            if (!result) {
+                exit.error = result.error();
+            } else if (info.si_pid != pid) {
+                exit.error = Error { "waitid", context.result };
+            }
+        }
+
+        if (!exit.error) {
+            if (info.si_code == CLD_EXITED) {
+                exit.exitCode = info.si_status;
+            } else {
+                exit.signal = info.si_status;
+            }
+        }
+
+        callback(context, exit);
+        return false;
+    }
+}
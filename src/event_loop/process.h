@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <liburing.h>
+
+#include "common.h"
+
+namespace event_loop {
+    struct SpawnOptions {
+        // Create pipes for the standard streams of the process, otherwise they are inherited
+        bool pipeInput = true;
+        bool pipeOutput = true;
+        bool pipeError = false;
+
+        // The working directory of the process, otherwise inherited
+        std::optional<std::filesystem::path> workingDirectory;
+
+        // The environment of the process ("NAME=value"), otherwise inherited
+        std::optional<std::vector<std::string>> environment;
+    };
+
+    /**
+     * A spawned process, where the piped standard streams are owned by the caller and closed as any other file
+     */
+    struct Process {
+        pid_t pid = -1;
+        std::optional<File> input;
+        std::optional<File> output;
+        std::optional<File> error;
+    };
+
+    struct ProcessExit {
+        pid_t pid = -1;
+
+        // The exit code if the process exited normally
+        std::optional<int> exitCode;
+
+        // The signal that terminated the process
+        std::optional<int> signal;
+
+        // Set if the process could not be reaped, where it may still be running and must be waited for again
+        std::optional<Error> error;
+    };
+
+    /**
+     * Spawns the given program (searched for in PATH) with posix_spawn
+     */
+    Expected<Process> spawnProcess(std::span<const std::string> arguments, const SpawnOptions& options);
+
+    /**
+     * Waits for a process to exit (IORING_OP_WAITID), reaping it. Interrupted waits are retried, and if the wait fails
+     * otherwise (e.g. not supported by the kernel or cancelled), the process is reaped without blocking if it has exited.
+     */
+    struct WaitProcessOperation {
+        static constexpr const char* name = "WaitProcess";
+
+        using Callback = std::function<void (EventContext& context, const ProcessExit&)>;
+
+        pid_t pid = -1;
+        Callback callback;
+        siginfo_t info {};
+
+        void prepare(io_uring_sqe* sqe);
+        bool complete(EventContext& context);
+    };
+}
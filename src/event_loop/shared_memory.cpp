@@ -0,0 +1,439 @@
+#include "shared_memory.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace event_loop {
+    namespace {
+        constexpr std::uint64_t channelMagic = 0x6576656e746c6f6f;
+
+        std::size_t pageSize() {
+            return (std::size_t)sysconf(_SC_PAGESIZE);
+        }
+    }
+
+    std::size_t SharedMemoryChannel::headerSize() {
+        return ((sizeof(Header) + pageSize() - 1) / pageSize()) * pageSize();
+    }
+
+    Expected<std::unique_ptr<SharedMemoryChannel>> SharedMemoryChannel::create(std::size_t capacity) {
+        capacity = std::max(((capacity + pageSize() - 1) / pageSize()) * pageSize(), pageSize());
+
+        // Sealed against resizing, as the other process maps it as well
+        auto memoryFd = checkSystemCall(memfd_create("event_loop_channel", MFD_CLOEXEC | MFD_ALLOW_SEALING), "memfd_create");
+        if (!memoryFd) {
+            return memoryFd.error();
+        }
+
+        auto result = checkSystemCall(ftruncate(*memoryFd, (off_t)(headerSize() + 2 * capacity)), "ftruncate");
+        if (result) {
+            result = checkSystemCall(fcntl(*memoryFd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL), "fcntl");
+        }
+
+        if (!result) {
+            ::close(*memoryFd);
+            return result.error();
+        }
+
+        auto channel = map(File { *memoryFd }, capacity, true);
+        if (!channel) {
+            ::close(*memoryFd);
+            return channel.error();
+        }
+
+        auto header = new ((*channel)->mMapping) Header {};
+        header->capacity = capacity;
+        header->magic = channelMagic;
+        return channel;
+    }
+
+    Expected<std::unique_ptr<SharedMemoryChannel>> SharedMemoryChannel::open(File memoryFile) {
+        // Without the seals the other process could shrink the memfd, faulting any access beyond its new end
+        auto seals = checkSystemCall(fcntl(memoryFile.fd, F_GET_SEALS), "fcntl");
+        if (!seals) {
+            ::close(memoryFile.fd);
+            return seals.error();
+        }
+
+        if ((*seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW)) {
+            ::close(memoryFile.fd);
+            return Error { "open_channel", -EPERM };
+        }
+
+        struct stat stats {};
+        auto result = checkSystemCall(fstat(memoryFile.fd, &stats), "fstat");
+        if (!result) {
+            ::close(memoryFile.fd);
+            return result.error();
+        }
+
+        auto size = (std::size_t)stats.st_size;
+        if (size <= headerSize() || (size - headerSize()) % (2 * pageSize()) != 0) {
+            ::close(memoryFile.fd);
+            return Error { "open_channel", -EINVAL };
+        }
+
+        auto channel = map(memoryFile, (size - headerSize()) / 2, false);
+        if (!channel) {
+            ::close(memoryFile.fd);
+            return channel.error();
+        }
+
+        // Closed along with the channel from here on
+        auto header = (*channel)->mHeader;
+        if (header->magic != channelMagic || header->capacity != (*channel)->mCapacity) {
+            // Not a channel, which must not be marked as closed
+            (*channel)->mHeader = nullptr;
+            return Error { "open_channel", -EINVAL };
+        }
+
+        return channel;
+    }
+
+    Expected<std::unique_ptr<SharedMemoryChannel>> SharedMemoryChannel::map(File memoryFile, std::size_t capacity, bool creator) {
+        // The header, followed by the data of each ring mapped twice back to back
+        auto mappingSize = headerSize() + 4 * capacity;
+        auto reserved = mmap(nullptr, mappingSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) {
+            return Error::fromErrorNumber("mmap");
+        }
+
+        std::unique_ptr<SharedMemoryChannel> channel { new SharedMemoryChannel() };
+        channel->mMapping = (std::uint8_t*)reserved;
+        channel->mMappingSize = mappingSize;
+
+        struct Mapping {
+            std::uint8_t* address;
+            std::size_t size;
+            off_t offset;
+        };
+
+        auto data = channel->mMapping + headerSize();
+        auto firstOffset = (off_t)headerSize();
+        auto secondOffset = (off_t)(headerSize() + capacity);
+        Mapping mappings[] {
+            { channel->mMapping, headerSize(), 0 },
+            { data, capacity, firstOffset },
+            { data + capacity, capacity, firstOffset },
+            { data + 2 * capacity, capacity, secondOffset },
+            { data + 3 * capacity, capacity, secondOffset }
+        };
+
+        for (auto& mapping : mappings) {
+            if (mmap(mapping.address, mapping.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memoryFile.fd, mapping.offset) == MAP_FAILED) {
+                // Unmapped by the channel
+                return Error::fromErrorNumber("mmap");
+            }
+        }
+
+        channel->mMemoryFile = memoryFile;
+        channel->mHeader = (Header*)channel->mMapping;
+        channel->mCapacity = capacity;
+
+        // The creator sends on the first ring and receives on the second, the other side the other way around
+        auto first = creator ? 0 : 1;
+        channel->mSendRing = &channel->mHeader->rings[first];
+        channel->mSendData = data + 2 * capacity * first;
+        channel->mReceiveRing = &channel->mHeader->rings[1 - first];
+        channel->mReceiveData = data + 2 * capacity * (1 - first);
+        return channel;
+    }
+
+    SharedMemoryChannel::~SharedMemoryChannel() {
+        // Wakes up the other side, which would otherwise wait forever
+        if (mHeader != nullptr) {
+            close();
+        }
+
+        if (mMapping != nullptr) {
+            munmap(mMapping, mMappingSize);
+        }
+
+        if (mMemoryFile) {
+            ::close(mMemoryFile.fd);
+        }
+    }
+
+    std::size_t SharedMemoryChannel::capacity() const {
+        return mCapacity;
+    }
+
+    File SharedMemoryChannel::memoryFile() const {
+        return mMemoryFile;
+    }
+
+    void SharedMemoryChannel::wake(std::atomic<std::uint32_t>& waiting) {
+        // Checked first, as the exchange would bounce the cache line between the processes on every operation
+        if (waiting.load(std::memory_order_seq_cst) == 1 && waiting.exchange(0, std::memory_order_seq_cst) == 1) {
+            futexWake(waiting, 1, true);
+        }
+    }
+
+    bool SharedMemoryChannel::hasData() const {
+        return mReceiveRing->written.load(std::memory_order_seq_cst) != mReceiveRing->read.load(std::memory_order_relaxed);
+    }
+
+    std::size_t SharedMemoryChannel::used(std::uint64_t written, std::uint64_t read) const {
+        // The positions are written by the other process as well, which must not make accesses leave the ring
+        return (std::size_t)std::min<std::uint64_t>(written - read, mCapacity);
+    }
+
+    bool SharedMemoryChannel::hasRoom() const {
+        return used(mSendRing->written.load(std::memory_order_relaxed), mSendRing->read.load(std::memory_order_seq_cst)) < mCapacity;
+    }
+
+    std::size_t SharedMemoryChannel::trySend(std::span<const std::uint8_t> data) {
+        auto written = mSendRing->written.load(std::memory_order_relaxed);
+        auto read = mSendRing->read.load(std::memory_order_acquire);
+
+        auto size = std::min<std::size_t>(data.size(), mCapacity - used(written, read));
+        if (size == 0) {
+            return 0;
+        }
+
+        std::memcpy(mSendData + written % mCapacity, data.data(), size);
+        mSendRing->written.store(written + size, std::memory_order_seq_cst);
+
+        wake(mSendRing->dataWaiting);
+        return size;
+    }
+
+    std::span<const std::uint8_t> SharedMemoryChannel::readable() const {
+        auto read = mReceiveRing->read.load(std::memory_order_relaxed);
+        auto written = mReceiveRing->written.load(std::memory_order_acquire);
+        return { mReceiveData + read % mCapacity, used(written, read) };
+    }
+
+    void SharedMemoryChannel::consume(std::size_t size) {
+        auto read = mReceiveRing->read.load(std::memory_order_relaxed);
+        auto written = mReceiveRing->written.load(std::memory_order_acquire);
+        mReceiveRing->read.store(read + std::min(size, used(written, read)), std::memory_order_seq_cst);
+
+        wake(mReceiveRing->roomWaiting);
+    }
+
+    bool SharedMemoryChannel::send(std::span<const std::uint8_t> data) {
+        while (!data.empty()) {
+            if (closed()) {
+                return false;
+            }
+
+            data = data.subspan(trySend(data));
+            if (!data.empty() && armWait(mSendRing->roomWaiting, [this]() { return hasRoom() || closed(); })) {
+                futexWait(mSendRing->roomWaiting, 1, {}, true);
+            }
+        }
+
+        return true;
+    }
+
+    std::span<const std::uint8_t> SharedMemoryChannel::receive() {
+        while (true) {
+            auto data = readable();
+            if (!data.empty() || closed()) {
+                return data;
+            }
+
+            if (armWait(mReceiveRing->dataWaiting, [this]() { return hasData() || closed(); })) {
+                futexWait(mReceiveRing->dataWaiting, 1, {}, true);
+            }
+        }
+    }
+
+    void SharedMemoryChannel::close() {
+        close(*mHeader);
+        cancelHangup();
+    }
+
+    void SharedMemoryChannel::cancelHangup() {
+        if (mHangupLoop == nullptr) {
+            return;
+        }
+
+        // Completes on its own if the loop cannot cancel it now, its own mapping keeps it valid until then
+        static_cast<void>(mHangupLoop->tryCancelOperation(mHangupEventId));
+        mHangupLoop = nullptr;
+    }
+
+    void SharedMemoryChannel::close(Header& header) {
+        header.closed.store(1, std::memory_order_seq_cst);
+
+        for (auto& ring : header.rings) {
+            wake(ring.dataWaiting);
+            wake(ring.roomWaiting);
+        }
+    }
+
+    bool SharedMemoryChannel::closed() const {
+        return mHeader->closed.load(std::memory_order_seq_cst) != 0;
+    }
+
+    void SharedMemoryChannel::closeOnHangup(EventLoop& eventLoop, Socket socket) {
+        tryCloseOnHangup(eventLoop, socket).valueOrThrow();
+    }
+
+    Expected<> SharedMemoryChannel::tryCloseOnHangup(EventLoop& eventLoop, Socket socket) {
+        cancelHangup();
+
+        auto header = mmap(nullptr, headerSize(), PROT_READ | PROT_WRITE, MAP_SHARED, mMemoryFile.fd, 0);
+        if (header == MAP_FAILED) {
+            return Error::fromErrorNumber("mmap");
+        }
+
+        auto result = eventLoop.trySubmitOperation(ChannelHangupOperation {
+            socket,
+            std::unique_ptr<void, ChannelHangupOperation::Unmap> { header, { headerSize() } }
+        });
+
+        if (!result) {
+            return result.error();
+        }
+
+        mHangupLoop = &eventLoop;
+        mHangupEventId = *result;
+        return {};
+    }
+
+    void SharedMemoryChannel::offer(EventLoop& eventLoop, Socket socket, std::size_t capacity, OpenCallback callback) {
+        tryOffer(eventLoop, socket, capacity, std::move(callback)).valueOrThrow();
+    }
+
+    Expected<> SharedMemoryChannel::tryOffer(EventLoop& eventLoop, Socket socket, std::size_t capacity, OpenCallback callback) {
+        auto channel = create(capacity);
+        if (!channel) {
+            return channel.error();
+        }
+
+        auto memoryFile = (*channel)->memoryFile();
+
+        // Shared, as operations are copied into the loop
+        auto created = std::make_shared<std::unique_ptr<SharedMemoryChannel>>(std::move(*channel));
+        auto result = eventLoop.trySubmitOperation(SendDescriptorOperation {
+            socket,
+            memoryFile,
+            [created, callback = std::move(callback)](EventContext& context) {
+                if (context.result < 0) {
+                    callback(context, Error { "sendmsg", context.result });
+                } else {
+                    callback(context, std::move(*created));
+                }
+            }
+        });
+
+        if (!result) {
+            return result.error();
+        }
+
+        return {};
+    }
+
+    void SharedMemoryChannel::accept(EventLoop& eventLoop, Socket socket, OpenCallback callback) {
+        tryAccept(eventLoop, socket, std::move(callback)).valueOrThrow();
+    }
+
+    Expected<> SharedMemoryChannel::tryAccept(EventLoop& eventLoop, Socket socket, OpenCallback callback) {
+        auto result = eventLoop.trySubmitOperation(ReceiveDescriptorOperation {
+            socket,
+            [callback = std::move(callback)](EventContext& context, Expected<AnyFd> fd) {
+                if (!fd) {
+                    callback(context, fd.error());
+                } else {
+                    callback(context, open(File { fd->fd }));
+                }
+            }
+        });
+
+        if (!result) {
+            return result.error();
+        }
+
+        return {};
+    }
+
+    void ChannelHangupOperation::Unmap::operator()(void* address) const {
+        munmap(address, size);
+    }
+
+    void ChannelHangupOperation::prepare(io_uring_sqe* sqe) {
+        io_uring_prep_poll_add(sqe, socket.fd, POLLRDHUP);
+    }
+
+    bool ChannelHangupOperation::complete(EventContext& context) {
+        // Cancelled or failed, where the channel is left as it is
+        if (context.result < 0) {
+            return false;
+        }
+
+        if ((context.result & (POLLRDHUP | POLLHUP | POLLERR)) == 0) {
+            return true;
+        }
+
+        SharedMemoryChannel::close(*(SharedMemoryChannel::Header*)header.get());
+        return false;
+    }
+
+    void SendDescriptorOperation::prepare(io_uring_sqe* sqe) {
+        // Set up here, as the operation is moved before being prepared
+        dataVector = { &payload, 1 };
+        header = {};
+        header.msg_iov = &dataVector;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        auto controlHeader = CMSG_FIRSTHDR(&header);
+        controlHeader->cmsg_level = SOL_SOCKET;
+        controlHeader->cmsg_type = SCM_RIGHTS;
+        controlHeader->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(controlHeader), &fd.fd, sizeof(int));
+
+        io_uring_prep_sendmsg(sqe, socket.fd, &header, MSG_NOSIGNAL);
+    }
+
+    bool SendDescriptorOperation::complete(EventContext& context) {
+        if (callback) {
+            callback(context);
+        }
+
+        return false;
+    }
+
+    void ReceiveDescriptorOperation::prepare(io_uring_sqe* sqe) {
+        dataVector = { &payload, 1 };
+        header = {};
+        header.msg_iov = &dataVector;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        io_uring_prep_recvmsg(sqe, socket.fd, &header, MSG_CMSG_CLOEXEC);
+    }
+
+    bool ReceiveDescriptorOperation::complete(EventContext& context) {
+        if (!callback) {
+            return false;
+        }
+
+        if (context.result < 0) {
+            callback(context, Error { "recvmsg", context.result });
+            return false;
+        }
+
+        auto controlHeader = CMSG_FIRSTHDR(&header);
+        if (context.result == 0 || controlHeader == nullptr || controlHeader->cmsg_level != SOL_SOCKET || controlHeader->cmsg_type != SCM_RIGHTS) {
+            callback(context, Error { "recvmsg", -EBADMSG });
+            return false;
+        }
+
+        int fd = -1;
+        std::memcpy(&fd, CMSG_DATA(controlHeader), sizeof(int));
+        callback(context, AnyFd { fd });
+        return false;
+    }
+}
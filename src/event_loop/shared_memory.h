@@ -0,0 +1,331 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <liburing.h>
+
+#include "common.h"
+#include "buffer.h"
+#include "loop.h"
+#include "sync.h"
+
+namespace event_loop {
+    /**
+     * One direction of a shared memory channel, written by a single producer and read by a single consumer
+     */
+    struct SharedRingHeader {
+        // Total bytes written and read, the positions in the ring are these modulo the capacity
+        alignas(64) std::atomic<std::uint64_t> written { 0 };
+        alignas(64) std::atomic<std::uint64_t> read { 0 };
+
+        // Futex words, set to 1 by a side before waiting for data (consumer) or room (producer) and cleared by the
+        // other side when waking it up
+        alignas(64) std::atomic<std::uint32_t> dataWaiting { 0 };
+        alignas(64) std::atomic<std::uint32_t> roomWaiting { 0 };
+    };
+
+    /**
+     * Bidirectional byte stream between processes on the same host through shared memory, without copies through the
+     * kernel. Each direction is a single producer single consumer ring in a memfd, mapped twice back to back so that
+     * data is always contiguous. Waiting for data or room is done with shared futexes, on the loop or blocking.
+     *
+     * The memfd is created by one process (create) and shared with the other over a unix socket (offer and accept).
+     * A channel must outlive the waits of event loops, and only one send and one receive may be waiting at a time.
+     * Destroying either side closes the channel.
+     */
+    class SharedMemoryChannel {
+    private:
+        friend struct ChannelHangupOperation;
+
+        struct Header {
+            std::uint64_t magic = 0;
+            std::uint64_t capacity = 0;
+
+            // Set by either side when closing the channel
+            alignas(64) std::atomic<std::uint32_t> closed { 0 };
+
+            SharedRingHeader rings[2];
+        };
+
+        std::uint8_t* mMapping = nullptr;
+        std::size_t mMappingSize = 0;
+        File mMemoryFile { -1 };
+
+        Header* mHeader = nullptr;
+        std::size_t mCapacity = 0;
+
+        SharedRingHeader* mSendRing = nullptr;
+        std::uint8_t* mSendData = nullptr;
+        SharedRingHeader* mReceiveRing = nullptr;
+        std::uint8_t* mReceiveData = nullptr;
+
+        // The poll of closeOnHangup, cancelled when closing
+        EventLoop* mHangupLoop = nullptr;
+        EventId mHangupEventId = 0;
+
+        SharedMemoryChannel() = default;
+        static std::size_t headerSize();
+        static Expected<std::unique_ptr<SharedMemoryChannel>> map(File memoryFile, std::size_t capacity, bool creator);
+
+        static void wake(std::atomic<std::uint32_t>& waiting);
+        static void close(Header& header);
+        void cancelHangup();
+
+        /**
+         * Prepares waiting on the given word, returns false if the waited for condition became true meanwhile
+         */
+        template<typename Condition>
+        static bool armWait(std::atomic<std::uint32_t>& waiting, Condition condition) {
+            waiting.store(1, std::memory_order_seq_cst);
+            return !condition();
+        }
+
+        std::size_t used(std::uint64_t written, std::uint64_t read) const;
+        bool hasData() const;
+        bool hasRoom() const;
+
+        /**
+         * Calls the callback with all received data until no data is left, it returns false or the channel is closed.
+         * Returns false when data should be waited for.
+         */
+        template<typename Callback>
+        bool drain(EventLoop& eventLoop, Callback& callback) {
+            while (true) {
+                auto data = readable();
+                if (!data.empty()) {
+                    auto keep = callback(eventLoop, data);
+                    consume(data.size());
+                    if (!keep) {
+                        return true;
+                    }
+
+                    continue;
+                }
+
+                if (closed()) {
+                    callback(eventLoop, std::span<const std::uint8_t> {});
+                    return true;
+                }
+
+                if (armWait(mReceiveRing->dataWaiting, [this]() { return hasData() || closed(); })) {
+                    return false;
+                }
+            }
+        }
+
+        /**
+         * Sends the remaining data, returns false when room should be waited for
+         */
+        template<typename Callback>
+        bool sendRemaining(EventLoop& eventLoop, Buffer& data, std::size_t& sent, Callback& callback) {
+            while (true) {
+                if (closed()) {
+                    callback(eventLoop, false);
+                    return true;
+                }
+
+                sent += trySend({ data.data() + sent, data.size() - sent });
+                if (sent == data.size()) {
+                    callback(eventLoop, true);
+                    return true;
+                }
+
+                if (armWait(mSendRing->roomWaiting, [this]() { return hasRoom() || closed(); })) {
+                    return false;
+                }
+            }
+        }
+    public:
+        /**
+         * Creates a new channel with rings of at least the given capacity, rounded up to whole pages
+         */
+        static Expected<std::unique_ptr<SharedMemoryChannel>> create(std::size_t capacity);
+
+        /**
+         * Opens the other side of a channel, from the memfd received from the process that created it.
+         * Takes ownership of the memfd, which is closed on failure. Fails unless the memfd is sealed against resizing.
+         */
+        static Expected<std::unique_ptr<SharedMemoryChannel>> open(File memoryFile);
+
+        ~SharedMemoryChannel();
+
+        SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+        SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+
+        std::size_t capacity() const;
+
+        /**
+         * The memfd of the channel, for sharing it with another process
+         */
+        File memoryFile() const;
+
+        /**
+         * Sends as much of the given data as there is room for, returning the number of bytes sent
+         */
+        std::size_t trySend(std::span<const std::uint8_t> data);
+
+        /**
+         * Returns the data that has been received but not yet consumed
+         */
+        std::span<const std::uint8_t> readable() const;
+
+        /**
+         * Marks the given number of bytes at the start of the received data as read
+         */
+        void consume(std::size_t size);
+
+        /**
+         * Blocks the calling thread until all data is sent, returns false if the channel was closed
+         */
+        bool send(std::span<const std::uint8_t> data);
+
+        /**
+         * Blocks the calling thread until data is received, returns empty data if the channel was closed
+         */
+        std::span<const std::uint8_t> receive();
+
+        /**
+         * Closes the channel for both sides, waking them up
+         */
+        void close();
+        bool closed() const;
+
+        /**
+         * Closes the channel once the given unix socket hangs up, such as when the other process exits or crashes.
+         * Closing the socket in this process does not count, as the pending poll keeps it open until the channel is
+         * closed. The channel must then be closed and destroyed on the thread of the loop, which must outlive it.
+         */
+        void closeOnHangup(EventLoop& eventLoop, Socket socket);
+        Expected<> tryCloseOnHangup(EventLoop& eventLoop, Socket socket);
+
+        /**
+         * Sends the data on the given event loop, calling the callback (void (EventLoop&, bool sent)) once all of it is
+         * sent, right away if there is room. The callback is called with false if the channel was closed or waiting for
+         * room failed.
+         */
+        template<typename Callback>
+        void send(EventLoop& eventLoop, Buffer data, Callback callback) {
+            std::size_t sent = 0;
+            if (sendRemaining(eventLoop, data, sent, callback)) {
+                return;
+            }
+
+            auto retry = [this, data = std::move(data), sent, callback = std::move(callback)](EventLoop& eventLoop, Expected<> woken) mutable {
+                if (!woken) {
+                    callback(eventLoop, false);
+                    return true;
+                }
+
+                return sendRemaining(eventLoop, data, sent, callback);
+            };
+
+            eventLoop.submitOperation(FutexWaitOperation<decltype(retry)> { &mSendRing->roomWaiting, 1, std::move(retry), true });
+        }
+
+        /**
+         * Receives data on the given event loop, calling the callback (bool (EventLoop&, std::span<const std::uint8_t>))
+         * with the received data, which is consumed once it returns. Returning false stops receiving.
+         * The callback is called with empty data when the channel is closed or waiting for data failed.
+         */
+        template<typename Callback>
+        void receive(EventLoop& eventLoop, Callback callback) {
+            if (drain(eventLoop, callback)) {
+                return;
+            }
+
+            auto retry = [this, callback = std::move(callback)](EventLoop& eventLoop, Expected<> woken) mutable {
+                if (!woken) {
+                    callback(eventLoop, std::span<const std::uint8_t> {});
+                    return true;
+                }
+
+                return drain(eventLoop, callback);
+            };
+
+            eventLoop.submitOperation(FutexWaitOperation<decltype(retry)> { &mReceiveRing->dataWaiting, 1, std::move(retry), true });
+        }
+
+        using OpenCallback = std::function<void (EventContext& context, Expected<std::unique_ptr<SharedMemoryChannel>> channel)>;
+
+        /**
+         * Creates a channel and sends its memfd over the given connected unix socket, calling the callback once sent
+         */
+        static void offer(EventLoop& eventLoop, Socket socket, std::size_t capacity, OpenCallback callback);
+        static Expected<> tryOffer(EventLoop& eventLoop, Socket socket, std::size_t capacity, OpenCallback callback);
+
+        /**
+         * Receives the memfd of a channel offered over the given connected unix socket and opens it
+         */
+        static void accept(EventLoop& eventLoop, Socket socket, OpenCallback callback);
+        static Expected<> tryAccept(EventLoop& eventLoop, Socket socket, OpenCallback callback);
+    };
+
+    /**
+     * Closes a shared memory channel when a socket hangs up (IORING_OP_POLL_ADD). Has its own mapping of the channel
+     * header, as the channel may be destroyed first.
+     */
+    struct ChannelHangupOperation {
+        static constexpr const char* name = "ChannelHangup";
+
+        struct Unmap {
+            std::size_t size = 0;
+            void operator()(void* address) const;
+        };
+
+        Socket socket { -1 };
+        std::unique_ptr<void, Unmap> header;
+
+        void prepare(io_uring_sqe* sqe);
+        bool complete(EventContext& context);
+    };
+
+    /**
+     * Sends a file descriptor over a unix socket (IORING_OP_SENDMSG with SCM_RIGHTS)
+     */
+    struct SendDescriptorOperation {
+        static constexpr const char* name = "SendDescriptor";
+
+        using Callback = std::function<void (EventContext& context)>;
+
+        Socket socket { -1 };
+        AnyFd fd { -1 };
+        Callback callback;
+
+        // A single byte is sent along, as ancillary data needs a payload
+        std::uint8_t payload = 0;
+        iovec dataVector {};
+        msghdr header {};
+        alignas(cmsghdr) std::uint8_t control[CMSG_SPACE(sizeof(int))] {};
+
+        void prepare(io_uring_sqe* sqe);
+        bool complete(EventContext& context);
+    };
+
+    /**
+     * Receives a file descriptor sent over a unix socket (IORING_OP_RECVMSG with SCM_RIGHTS)
+     */
+    struct ReceiveDescriptorOperation {
+        static constexpr const char* name = "ReceiveDescriptor";
+
+        using Callback = std::function<void (EventContext& context, Expected<AnyFd> fd)>;
+
+        Socket socket { -1 };
+        Callback callback;
+
+        std::uint8_t payload = 0;
+        iovec dataVector {};
+        msghdr header {};
+        alignas(cmsghdr) std::uint8_t control[CMSG_SPACE(sizeof(int))] {};
+
+        void prepare(io_uring_sqe* sqe);
+        bool complete(EventContext& context);
+    };
+}
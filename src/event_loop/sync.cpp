@@ -0,0 +1,66 @@
+#include "sync.h"
+
+namespace event_loop {
+    bool AsyncMutex::tryLock() {
+        std::uint32_t expected = 0;
+        return mState.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+    }
+
+    void AsyncMutex::lock() {
+        std::uint32_t state = 0;
+        if (mState.compare_exchange_strong(state, 1, std::memory_order_acquire)) {
+            return;
+        }
+
+        if (state != 2) {
+            state = mState.exchange(2, std::memory_order_acquire);
+        }
+
+        while (state != 0) {
+            futexWait(mState, 2);
+            state = mState.exchange(2, std::memory_order_acquire);
+        }
+    }
+
+    void AsyncMutex::unlock() {
+        if (mState.exchange(0, std::memory_order_release) == 2) {
+            futexWake(mState, 1);
+        }
+    }
+
+    AsyncSemaphore::AsyncSemaphore(std::uint32_t count)
+        : mCount(count) {
+
+    }
+
+    std::uint32_t AsyncSemaphore::count() const {
+        return mCount.load(std::memory_order_relaxed);
+    }
+
+    bool AsyncSemaphore::tryAcquire() {
+        auto count = mCount.load(std::memory_order_relaxed);
+        while (count > 0) {
+            if (mCount.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void AsyncSemaphore::acquire() {
+        while (!tryAcquire()) {
+            // Registered before waiting, so that a release either sees the waiter or the wait sees the release
+            mWaiters.fetch_add(1);
+            futexWait(mCount, 0);
+            mWaiters.fetch_sub(1);
+        }
+    }
+
+    void AsyncSemaphore::release(std::uint32_t count) {
+        mCount.fetch_add(count);
+        if (mWaiters.load() > 0) {
+            futexWake(mCount, (int)count);
+        }
+    }
+}
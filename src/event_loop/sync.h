@@ -0,0 +1,309 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <linux/futex.h>
+
+#include <liburing.h>
+
+#include "common.h"
+#include "futex.h"
+#include "loop.h"
+
+// The futex2 flags used by IORING_OP_FUTEX_WAIT, only defined by the kernel headers from Linux 6.7 on
+#ifndef FUTEX2_SIZE_U32
+#define FUTEX2_SIZE_U32 0x02
+#endif
+
+#ifndef FUTEX2_PRIVATE
+#define FUTEX2_PRIVATE FUTEX_PRIVATE_FLAG
+#endif
+
+#ifndef FUTEX_BITSET_MATCH_ANY
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+#endif
+
+namespace event_loop {
+    /**
+     * Waits on the loop (IORING_OP_FUTEX_WAIT) while the given word has the expected value, then calls retry
+     * (bool (EventLoop&, Expected<> woken)). Waits again until retry returns true. If waiting fails (e.g. cancelled),
+     * retry is called with the error and the wait ends.
+     */
+    template<typename Retry>
+    struct FutexWaitOperation {
+        static constexpr const char* name = "FutexWait";
+
+        std::atomic<std::uint32_t>* word = nullptr;
+        std::uint32_t expected = 0;
+        Retry retry;
+
+        // Woken up by other processes, where the word is in shared memory
+        bool shared = false;
+
+        void prepare(io_uring_sqe* sqe) {
+            auto flags = FUTEX2_SIZE_U32 | (shared ? 0 : FUTEX2_PRIVATE);
+            io_uring_prep_futex_wait(sqe, (std::uint32_t*)word, expected, FUTEX_BITSET_MATCH_ANY, flags, 0);
+        }
+
+        bool complete(EventContext& context) {
+            // The value already changed (EAGAIN) or interrupted, both handled like being woken up
+            if (context.result < 0 && context.result != -EAGAIN && context.result != -EINTR) {
+                retry(context.eventLoop, Error { "futex_wait", context.result });
+                return false;
+            }
+
+            return !retry(context.eventLoop, Expected<> {});
+        }
+    };
+
+    /**
+     * Mutex that can be locked both by blocking threads and without blocking by event loops.
+     * Must outlive the waits of event loops.
+     */
+    class AsyncMutex {
+    private:
+        // 0 = unlocked, 1 = locked, 2 = locked with possible waiters
+        std::atomic<std::uint32_t> mState { 0 };
+    public:
+        AsyncMutex() = default;
+
+        AsyncMutex(const AsyncMutex&) = delete;
+        AsyncMutex& operator=(const AsyncMutex&) = delete;
+
+        bool tryLock();
+
+        /**
+         * Blocks the calling thread until locked
+         */
+        void lock();
+        void unlock();
+
+        /**
+         * Locks the mutex on the given event loop, calling the callback (void (EventLoop&, Expected<> locked)) when locked,
+         * right away if not contended. The callback is responsible for unlocking, unless called with an error.
+         */
+        template<typename Callback>
+        void lock(EventLoop& eventLoop, Callback callback) {
+            if (tryLock() || mState.exchange(2, std::memory_order_acquire) == 0) {
+                callback(eventLoop, Expected<> {});
+                return;
+            }
+
+            auto retry = [this, callback = std::move(callback)](EventLoop& eventLoop, Expected<> woken) mutable {
+                if (!woken) {
+                    callback(eventLoop, woken);
+                    return true;
+                }
+
+                if (mState.exchange(2, std::memory_order_acquire) != 0) {
+                    return false;
+                }
+
+                callback(eventLoop, Expected<> {});
+                return true;
+            };
+
+            eventLoop.submitOperation(FutexWaitOperation<decltype(retry)> { &mState, 2, std::move(retry) });
+        }
+    };
+
+    /**
+     * Counting semaphore that can be acquired both by blocking threads and without blocking by event loops.
+     * Must outlive the waits of event loops.
+     */
+    class AsyncSemaphore {
+    private:
+        std::atomic<std::uint32_t> mCount;
+        std::atomic<std::uint32_t> mWaiters { 0 };
+    public:
+        explicit AsyncSemaphore(std::uint32_t count = 0);
+
+        AsyncSemaphore(const AsyncSemaphore&) = delete;
+        AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+        std::uint32_t count() const;
+
+        bool tryAcquire();
+
+        /**
+         * Blocks the calling thread until acquired
+         */
+        void acquire();
+        void release(std::uint32_t count = 1);
+
+        /**
+         * Acquires the semaphore on the given event loop, calling the callback (void (EventLoop&, Expected<> acquired))
+         * when acquired, right away if available
+         */
+        template<typename Callback>
+        void acquire(EventLoop& eventLoop, Callback callback) {
+            if (tryAcquire()) {
+                callback(eventLoop, Expected<> {});
+                return;
+            }
+
+            // Registered before waiting, so that a release either sees the waiter or the wait sees the release
+            mWaiters.fetch_add(1);
+
+            auto retry = [this, callback = std::move(callback)](EventLoop& eventLoop, Expected<> woken) mutable {
+                if (woken && !tryAcquire()) {
+                    return false;
+                }
+
+                mWaiters.fetch_sub(1);
+                callback(eventLoop, woken);
+                return true;
+            };
+
+            eventLoop.submitOperation(FutexWaitOperation<decltype(retry)> { &mCount, 0, std::move(retry) });
+        }
+    };
+
+    /**
+     * Bounded multi-producer multi-consumer channel, where both threads and event loops can send and receive.
+     * The storage is allocated up front. Must outlive the waits of event loops.
+     */
+    template<typename T>
+    class AsyncChannel {
+    private:
+        // Each slot is numbered with the position it can be written at next, and one past that once written
+        struct Slot {
+            std::atomic<std::size_t> sequence { 0 };
+            std::optional<T> value;
+        };
+
+        std::vector<Slot> mSlots;
+        alignas(64) std::atomic<std::size_t> mHead { 0 };
+        alignas(64) std::atomic<std::size_t> mTail { 0 };
+
+        AsyncSemaphore mFree;
+        AsyncSemaphore mUsed;
+
+        /**
+         * Waits for the slot to reach the given sequence. A slot is reserved through the semaphores before, so this only
+         * waits for another sender or receiver that is in the middle of moving a value in or out of it, without locking.
+         */
+        static void waitForSequence(const Slot& slot, std::size_t sequence) {
+            while (slot.sequence.load(std::memory_order_acquire) != sequence) {
+                std::this_thread::yield();
+            }
+        }
+
+        void push(T value) {
+            auto position = mTail.fetch_add(1, std::memory_order_relaxed);
+            auto& slot = mSlots[position % mSlots.size()];
+            waitForSequence(slot, position);
+
+            slot.value.emplace(std::move(value));
+            slot.sequence.store(position + 1, std::memory_order_release);
+        }
+
+        T pop() {
+            auto position = mHead.fetch_add(1, std::memory_order_relaxed);
+            auto& slot = mSlots[position % mSlots.size()];
+            waitForSequence(slot, position + 1);
+
+            T value = std::move(*slot.value);
+            slot.value.reset();
+            slot.sequence.store(position + mSlots.size(), std::memory_order_release);
+            return value;
+        }
+    public:
+        explicit AsyncChannel(std::size_t capacity)
+            : mSlots(capacity),
+              mFree((std::uint32_t)capacity),
+              mUsed(0) {
+            for (std::size_t index = 0; index < capacity; index++) {
+                mSlots[index].sequence.store(index, std::memory_order_relaxed);
+            }
+        }
+
+        AsyncChannel(const AsyncChannel&) = delete;
+        AsyncChannel& operator=(const AsyncChannel&) = delete;
+
+        std::size_t capacity() const {
+            return mSlots.size();
+        }
+
+        /**
+         * Sends the value if there is room, where the value is only moved from if sent
+         */
+        bool trySend(T& value) {
+            if (!mFree.tryAcquire()) {
+                return false;
+            }
+
+            push(std::move(value));
+            mUsed.release();
+            return true;
+        }
+
+        std::optional<T> tryReceive() {
+            if (!mUsed.tryAcquire()) {
+                return {};
+            }
+
+            auto value = pop();
+            mFree.release();
+            return value;
+        }
+
+        /**
+         * Blocks the calling thread until there is room
+         */
+        void send(T value) {
+            mFree.acquire();
+            push(std::move(value));
+            mUsed.release();
+        }
+
+        /**
+         * Blocks the calling thread until there is a value
+         */
+        T receive() {
+            mUsed.acquire();
+            auto value = pop();
+            mFree.release();
+            return value;
+        }
+
+        /**
+         * Sends the value on the given event loop, calling the callback (void (EventLoop&, Expected<> sent)) once sent.
+         * The value is dropped if waiting for room failed.
+         */
+        template<typename Callback>
+        void send(EventLoop& eventLoop, T value, Callback callback) {
+            mFree.acquire(eventLoop, [this, value = std::move(value), callback = std::move(callback)](EventLoop& eventLoop, Expected<> acquired) mutable {
+                if (!acquired) {
+                    callback(eventLoop, acquired);
+                    return;
+                }
+
+                push(std::move(value));
+                mUsed.release();
+                callback(eventLoop, Expected<> {});
+            });
+        }
+
+        /**
+         * Receives a value on the given event loop, calling the callback (void (EventLoop&, Expected<T>)) with the value
+         */
+        template<typename Callback>
+        void receive(EventLoop& eventLoop, Callback callback) {
+            mUsed.acquire(eventLoop, [this, callback = std::move(callback)](EventLoop& eventLoop, Expected<> acquired) mutable {
+                if (!acquired) {
+                    callback(eventLoop, Expected<T> { acquired.error() });
+                    return;
+                }
+
+                auto value = pop();
+                mFree.release();
+                callback(eventLoop, Expected<T> { std::move(value) });
+            });
+        }
+    };
+}
@@ -1,7 +1,15 @@
 #include <iostream>
 #include <set>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
 
 #include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <pthread.h>
 #include <map>
 
 #include "event_loop/loop.h"
@@ -39,6 +47,8 @@ int mainChatServer(int argc, char* argv[]) {
 
     std::stop_source stopSource;
     EventLoop eventLoop;
+    eventLoop.stopOnSignal(SIGINT);
+    eventLoop.stopOnSignal(SIGTERM);
 
     auto tcpListener = eventLoop.tcpListen({}, 9000);
 
@@ -69,7 +79,7 @@ int mainChatServer(int argc, char* argv[]) {
                 return false;
             }
 
-            std::string text { (char*)response.data, response.size };
+            std::pmr::string text { (char*)response.data, response.size, &context.arena };
             std::cout << "Message: " << text;
 
             if (text == "exit\n") {
@@ -78,7 +88,9 @@ int mainChatServer(int argc, char* argv[]) {
                 return false;
             }
 
-            auto output = Buffer::fromString("Other: " + text);
+            std::pmr::string outputText { "Other: ", &context.arena };
+            outputText += text;
+            auto output = Buffer::fromString(outputText);
 
             SubmitGuard submitGuard(context.eventLoop);
             for (auto& [_, currentClient] : clients) {
@@ -160,16 +172,24 @@ int mainUdpServer(int argc, char* argv[]) {
 
     std::stop_source stopSource;
     EventLoop eventLoop;
+    eventLoop.stopOnSignal(SIGINT);
+    eventLoop.stopOnSignal(SIGTERM);
 
-    auto udpSocket = eventLoop.udpReceiver({}, 9000);
+    auto udpSocket = eventLoop.udpReceiver({}, 9000, UdpReceiverOptions { .genericReceiveOffload = true });
 
-    eventLoop.receive(udpSocket, Buffer { 1024 }, [](EventContext& context, const ReceiveEvent::Response& response) {
-        if (response.size == 0) {
+    eventLoop.receiveDatagrams(udpSocket, ReceiveDatagramsOptions { .bufferCount = 64, .bufferSize = 64 * 1024 }, [udpSocket](EventContext& context, const ReceiveDatagramsEvent::Response& response) {
+        if (context.result < 0) {
+            std::cout << "Failed to receive due to: " << *tryExtractError(context.result) << std::endl;
             return false;
         }
 
+        auto [ip, port] = getEndpoint(std::get<sockaddr_in>(response.source));
         std::string text { (char*)response.data, response.size };
-        std::cout << "Message: " << text;
+        std::cout << "Message from " << ip << ":" << port << ": " << text;
+
+        Buffer reply { response.size };
+        std::memcpy(reply.data(), response.data, response.size);
+        context.eventLoop.sendTo(udpSocket, response.source, std::move(reply), {});
 
         return true;
     });
@@ -179,12 +199,62 @@ int mainUdpServer(int argc, char* argv[]) {
     return 0;
 }
 
+int mainReusePortServer(int argc, char* argv[]) {
+    using namespace event_loop;
+
+    std::uint32_t numLoops = std::max(std::thread::hardware_concurrency(), 1u);
+    if (argc >= 3) {
+        numLoops = (std::uint32_t)std::stoul(argv[2]);
+    }
+
+    // Listeners join the reuseport group in bind order, so bind them in CPU order before starting the threads
+    std::vector<std::unique_ptr<EventLoop>> eventLoops;
+    std::vector<TcpListener> listeners;
+    for (std::uint32_t cpu = 0; cpu < numLoops; cpu++) {
+        auto& eventLoop = *eventLoops.emplace_back(std::make_unique<EventLoop>());
+        listeners.push_back(eventLoop.tcpListen({}, 9000, TcpListenOptions { .reusePort = { .enabled = true, .cpuGroupSize = numLoops } }));
+    }
+
+    // Blocked before the threads are started, so that only the signalfd of the first loop receives them
+    eventLoops.front()->stopOnSignal(SIGINT);
+    eventLoops.front()->stopOnSignal(SIGTERM);
+
+    std::stop_source stopSource;
+    std::vector<std::thread> threads;
+    for (std::uint32_t cpu = 0; cpu < numLoops; cpu++) {
+        threads.emplace_back([&, cpu]() {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(cpu, &cpuSet);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+
+            auto& eventLoop = *eventLoops[cpu];
+            eventLoop.accept(listeners[cpu], [cpu](EventContext& context, const AcceptEvent::Response& response) {
+                ChatClient client { response.client, response.clientAddress };
+                std::cout << "Loop on CPU " << cpu << " (running on CPU " << sched_getcpu() << ") accepted client: " << client << std::endl;
+                context.eventLoop.close(response.client, {});
+                return true;
+            });
+
+            eventLoop.run(stopSource);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return 0;
+}
+
 int mainChatServerUnix(int argc, char* argv[]) {
     using namespace std::chrono_literals;
     using namespace event_loop;
 
     std::stop_source stopSource;
     EventLoop eventLoop;
+    eventLoop.stopOnSignal(SIGINT);
+    eventLoop.stopOnSignal(SIGTERM);
 
     auto unixListener = eventLoop.unixListen("test.sock");
 
@@ -214,7 +284,7 @@ int mainChatServerUnix(int argc, char* argv[]) {
                 return false;
             }
 
-            std::string text { (char*)response.data, response.size };
+            std::pmr::string text { (char*)response.data, response.size, &context.arena };
             std::cout << "Message: " << text;
 
             if (text == "exit\n") {
@@ -223,7 +293,9 @@ int mainChatServerUnix(int argc, char* argv[]) {
                 return false;
             }
 
-            auto output = Buffer::fromString("Other: " + text);
+            std::pmr::string outputText { "Other: ", &context.arena };
+            outputText += text;
+            auto output = Buffer::fromString(outputText);
 
             SubmitGuard submitGuard(context.eventLoop);
             for (auto& [_, currentClient] : clients) {
@@ -353,6 +425,8 @@ int main(int argc, char* argv[]) {
         return mainChatClient(argc, argv);
     } else if (command == "udp_server") {
         return mainUdpServer(argc, argv);
+    } else if (command == "reuseport_server") {
+        return mainReusePortServer(argc, argv);
     } else if (command == "unix_server") {
         return mainChatServerUnix(argc, argv);
     } else if (command == "unix_client") {